@@ -43,7 +43,7 @@ let package = Package(
             dependencies: ["AjisaiParser", "AjisaiUtil"]),
         .target(
             name: "AjisaiCodeGenerator",
-            dependencies: ["AjisaiSemanticAnalyzer", "AjisaiUtil"]),
+            dependencies: ["AjisaiParser", "AjisaiSemanticAnalyzer", "AjisaiUtil"]),
         // Tests
         .testTarget(
             name: "AjisaiParserTests",
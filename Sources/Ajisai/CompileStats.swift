@@ -0,0 +1,316 @@
+import AjisaiCodeGenerator
+import AjisaiParser
+import ArgumentParser
+import Foundation
+
+#if canImport(Glibc)
+    import Glibc
+#elseif canImport(Darwin)
+    import Darwin
+#endif
+
+enum CompileStatsFormat: String, ExpressibleByArgument, CaseIterable {
+    case table, json
+}
+
+struct PhaseStat: Codable {
+    let name: String
+    let wallTimeMs: Double
+    let peakMemoryKiB: Int
+    // フェーズごとのピークを測れなかった場合は true とし、peakMemoryKiB はプロセス開始からの最大 RSS となる
+    let peakMemoryIsCumulative: Bool
+}
+
+struct CompileStats: Codable {
+    var phases: [PhaseStat] = []
+    var tokenCount: Int = 0
+    var astNodeCount: Int = 0
+    var moduleCount: Int = 0
+    var acirInstructionCount: Int = 0
+    var generatedCBytes: Int = 0
+
+    // false のときは measure が body を実行するだけとなり、計測によるプロセスの状態の変更も行わない
+    var isEnabled: Bool = true
+
+    enum CodingKeys: String, CodingKey {
+        case phases, tokenCount, astNodeCount, moduleCount, acirInstructionCount, generatedCBytes
+    }
+
+    // body の実行にかかった時間と、その間のピークメモリ使用量を記録する
+    // children が true のときは、終了した子プロセス（cc など）のピークメモリ使用量を記録する
+    mutating func measure<T>(phase: String, children: Bool = false, _ body: () throws -> T)
+        rethrows -> T
+    {
+        guard isEnabled else {
+            return try body()
+        }
+
+        let canMeasurePhasePeak = !children && resetPeakMemory()
+
+        let start = DispatchTime.now().uptimeNanoseconds
+        let result = try body()
+        let end = DispatchTime.now().uptimeNanoseconds
+
+        let phasePeak: Int? =
+            if children {
+                peakMemoryKiB(children: true)
+            } else if canMeasurePhasePeak {
+                highWaterMarkKiB()
+            } else {
+                nil
+            }
+        phases.append(
+            PhaseStat(
+                name: phase, wallTimeMs: Double(end - start) / 1_000_000,
+                peakMemoryKiB: phasePeak ?? peakMemoryKiB(children: false),
+                peakMemoryIsCumulative: phasePeak == nil))
+        return result
+    }
+
+    func report<Target>(format: CompileStatsFormat, to target: inout Target)
+    where Target: TextOutputStream {
+        switch format {
+        case .table:
+            let nameWidth = max(phases.map { $0.name.count }.max() ?? 0, "phase".count)
+            func pad(_ str: String, _ width: Int) -> String {
+                str + String(repeating: " ", count: max(width - str.count, 0))
+            }
+            func padLeft(_ str: String, _ width: Int) -> String {
+                String(repeating: " ", count: max(width - str.count, 0)) + str
+            }
+
+            print(
+                "\(pad("phase", nameWidth))  \(padLeft("wall (ms)", 12))  \(padLeft("peak (KiB)", 12))",
+                to: &target)
+            var total = 0.0
+            for phase in phases {
+                total += phase.wallTimeMs
+                let peak = "\(phase.peakMemoryKiB)\(phase.peakMemoryIsCumulative ? "*" : "")"
+                print(
+                    "\(pad(phase.name, nameWidth))  \(padLeft(String(format: "%.3f", phase.wallTimeMs), 12))  \(padLeft(peak, 12))",
+                    to: &target)
+            }
+            print(
+                "\(pad("total", nameWidth))  \(padLeft(String(format: "%.3f", total), 12))",
+                to: &target)
+            if phases.contains(where: { phase in phase.peakMemoryIsCumulative }) {
+                print("* cumulative max RSS since process start", to: &target)
+            }
+            print("", to: &target)
+            print("tokens:             \(tokenCount)", to: &target)
+            print("AST nodes:          \(astNodeCount)", to: &target)
+            print("modules:            \(moduleCount)", to: &target)
+            print("ACIR instructions:  \(acirInstructionCount)", to: &target)
+            print("generated C bytes:  \(generatedCBytes)", to: &target)
+        case .json:
+            let encoder = JSONEncoder()
+            encoder.outputFormatting = [.prettyPrinted, .sortedKeys]
+            if let data = try? encoder.encode(self), let json = String(data: data, encoding: .utf8)
+            {
+                print(json, to: &target)
+            }
+        }
+    }
+}
+
+// Linux では /proc/self/clear_refs に 5 を書き込むと、ピーク RSS (VmHWM) が現在の RSS にリセットされる。
+// リセットできた場合は true を返す
+func resetPeakMemory() -> Bool {
+    #if canImport(Glibc)
+        guard let file = fopen("/proc/self/clear_refs", "w") else {
+            return false
+        }
+        let written = fputs("5", file) >= 0
+        return fclose(file) == 0 && written
+    #else
+        return false
+    #endif
+}
+
+// /proc/self/status の VmHWM（直前のリセット以降のピーク RSS）を KiB 単位で返す
+func highWaterMarkKiB() -> Int? {
+    #if canImport(Glibc)
+        guard let file = fopen("/proc/self/status", "r") else {
+            return nil
+        }
+        defer { fclose(file) }
+
+        var buf = [CChar](repeating: 0, count: 256)
+        while fgets(&buf, Int32(buf.count), file) != nil {
+            let line = String(cString: buf)
+            if line.hasPrefix("VmHWM:") {
+                // "VmHWM:     1234 kB" の形式
+                let fields = line.dropFirst("VmHWM:".count).split(whereSeparator: { $0.isWhitespace })
+                return fields.first.flatMap { field in Int(field) }
+            }
+        }
+        return nil
+    #else
+        return nil
+    #endif
+}
+
+// getrusage の ru_maxrss を KiB 単位で返す（Linux では KiB、macOS ではバイト単位で返される）
+func peakMemoryKiB(children: Bool) -> Int {
+    #if canImport(Glibc)
+        // Glibc の RUSAGE_SELF (0) と RUSAGE_CHILDREN (-1) は Swift から直接は渡せない
+        let who = __rusage_who_t(children ? -1 : 0)
+    #else
+        let who = children ? RUSAGE_CHILDREN : RUSAGE_SELF
+    #endif
+
+    var usage = rusage()
+    guard getrusage(who, &usage) == 0 else {
+        return 0
+    }
+
+    #if canImport(Glibc)
+        return Int(usage.ru_maxrss)
+    #else
+        return Int(usage.ru_maxrss) / 1024
+    #endif
+}
+
+//
+// AST のノード数・モジュール数の計数
+//
+
+func countModules(modDeclare: AjisaiModuleDeclareNode) -> Int {
+    modDeclare.mod.items.reduce(1) { acc, item in
+        if case let .moduleNode(moduleDeclare: subMod, span: _) = item {
+            acc + countModules(modDeclare: subMod)
+        } else {
+            acc
+        }
+    }
+}
+
+func countAstNodes(modDeclare: AjisaiModuleDeclareNode) -> Int {
+    modDeclare.mod.items.reduce(1) { acc, item in acc + countAstNodes(item: item) }
+}
+
+func countAstNodes(item: AjisaiModuleItemNode) -> Int {
+    switch item {
+    case let .moduleNode(moduleDeclare: modDeclare, span: _):
+        countAstNodes(modDeclare: modDeclare)
+    case let .valNode(declare: declare):
+        1 + countAstNodes(expr: declare.value)
+    case let .funcNode(funcDef: funcDef):
+        1 + countAstNodes(expr: funcDef.value)
+    case let .importNode(path: path, asName: _, span: _):
+        1 + countAstNodes(path: path)
+    case let .exprStmtNode(expr: expr, span: _):
+        1 + countAstNodes(expr: expr)
+    }
+}
+
+func countAstNodes(path: AjisaiPathNode) -> Int {
+    switch path {
+    case .pathEnd:
+        1
+    case let .path(sup: _, sub: sub, supSpan: _):
+        1 + countAstNodes(path: sub)
+    }
+}
+
+func countAstNodes(expr: AjisaiExprNode) -> Int {
+    switch expr {
+    case let .exprSeqNode(exprs: exprs, span: _):
+        exprs.reduce(1) { acc, expr in acc + countAstNodes(expr: expr) }
+    case let .fnExprNode(args: _, body: body, bodyTy: _, span: _):
+        1 + countAstNodes(expr: body)
+    case let .letNode(declares: declares, body: body, span: _):
+        declares.reduce(1 + countAstNodes(expr: body)) { acc, declare in
+            switch declare {
+            case let .variableDeclare(declare: declare):
+                acc + 1 + countAstNodes(expr: declare.value)
+            case let .funcDeclare(funcDef: funcDef):
+                acc + 1 + countAstNodes(expr: funcDef.value)
+            }
+        }
+    case let .ifNode(cond: cond, then: then, els: els, span: _):
+        1 + countAstNodes(expr: cond) + countAstNodes(expr: then) + countAstNodes(expr: els)
+    case let .callNode(callee: callee, args: args, span: _):
+        args.reduce(1 + countAstNodes(expr: callee)) { acc, arg in acc + countAstNodes(expr: arg) }
+    case let .binaryNode(opKind: _, left: left, right: right, span: _):
+        1 + countAstNodes(expr: left) + countAstNodes(expr: right)
+    case let .unaryNode(opKind: _, operand: operand, span: _):
+        1 + countAstNodes(expr: operand)
+    case let .pathNode(path):
+        countAstNodes(path: path)
+    case .boolNode, .integerNode, .stringNode, .variableNode, .unitNode:
+        1
+    }
+}
+
+//
+// ACIR の命令数の計数
+//
+
+func countInstructions(program: ACProgram) -> Int {
+    let funcDefsCount = program.funcDefs.reduce(0) { acc, def in
+        switch def {
+        case let .func_def(
+            funcName: _, params: _, returnTy: _, modName: _, envId: _, body: body):
+            acc + 1 + countInstructions(funcBody: body)
+        case let .closure_def(funcName: _, params: _, returnTy: _, envId: _, body: body):
+            acc + 1 + countInstructions(funcBody: body)
+        }
+    }
+    let modInitDefsCount = program.modInitDefs.reduce(0) { acc, modInit in
+        modInit.body.reduce(acc + 1) { acc, inst in
+            switch inst {
+            case .mod_init, .global_roottable_reg:
+                acc + 1
+            case let .modval_init(varName: _, modName: _, value: value):
+                acc + 1 + countInstructions(value: value)
+            case let .func_body_inst(inst):
+                acc + countInstructions(funcBody: [inst])
+            }
+        }
+    }
+    return program.decls.count + funcDefsCount + modInitDefsCount
+}
+
+func countInstructions(funcBody: [ACFuncBodyInst]) -> Int {
+    funcBody.reduce(0) { acc, inst in
+        switch inst {
+        case .funcframe_init, .funcframe_leave, .alloc_site_set, .roottable_init, .roottable_reg,
+            .roottable_unreg, .tmp_def_without_value, .str_make_static, .closure_make_static:
+            acc + 1
+        case let .tmp_def(envId: _, tmpVarIdx: _, ty: _, value: value),
+            let .tmp_store(envId: _, tmpVarIdx: _, value: value),
+            let .envvar_def(envId: _, varName: _, ty: _, value: value),
+            let .discard_value(value),
+            let .func_return(value: value):
+            acc + 1 + countInstructions(value: value)
+        case let .ifelse(cond: cond, then: then, els: els):
+            acc + 1 + countInstructions(value: cond) + countInstructions(funcBody: then)
+                + countInstructions(funcBody: els)
+        }
+    }
+}
+
+func countInstructions(value: ACValueInst) -> Int {
+    switch value {
+    case .builtin_load, .modval_load, .envvar_load, .tmp_load, .i32_const, .bool_const,
+        .str_const, .closure_const, .closure_make:
+        1
+    case let .func_call(callee: callee, args: args),
+        let .closure_call(callee: callee, args: args, argTypes: _, bodyType: _):
+        args.reduce(1 + countInstructions(value: callee)) { acc, arg in
+            acc + countInstructions(value: arg)
+        }
+    case let .i32_neg(operand: operand), let .bool_not(operand: operand):
+        1 + countInstructions(value: operand)
+    case let .i32_add(left: left, right: right), let .i32_sub(left: left, right: right),
+        let .i32_mul(left: left, right: right), let .i32_div(left: left, right: right),
+        let .i32_mod(left: left, right: right), let .i32_eq(left: left, right: right),
+        let .i32_ne(left: left, right: right), let .i32_lt(left: left, right: right),
+        let .i32_le(left: left, right: right), let .i32_gt(left: left, right: right),
+        let .i32_ge(left: left, right: right), let .bool_eq(left: left, right: right),
+        let .bool_ne(left: left, right: right), let .bool_and(left: left, right: right),
+        let .bool_or(left: left, right: right):
+        1 + countInstructions(value: left) + countInstructions(value: right)
+    }
+}
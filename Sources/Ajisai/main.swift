@@ -11,16 +11,24 @@ enum AjisaiError: Error {
 
 struct FileOutputStream: TextOutputStream {
     var fileHandle: FileHandle
+    private(set) var bytesWritten: Int = 0
 
     init(fileHandle: FileHandle) {
         self.fileHandle = fileHandle
     }
 
     public mutating func write(_ string: String) {
-        fileHandle.write(Data(string.utf8))
+        let data = Data(string.utf8)
+        bytesWritten += data.count
+        fileHandle.write(data)
     }
 }
 
+// ランタイムの GC が使用するヒープのレイアウト
+enum HeapLayout: String, ExpressibleByArgument, CaseIterable {
+    case treadmill, bitmap
+}
+
 @main
 struct Ajisai: ParsableCommand {
     @Argument var inputFile: String
@@ -28,7 +36,34 @@ struct Ajisai: ParsableCommand {
     @Option(name: [.short, .customLong("output")])
     var outputFile: String?
 
+    @Flag(
+        name: [.customLong("stats"), .customLong("time-passes")],
+        help: "Report wall time, peak memory and counters for each compiler phase to stderr.")
+    var showStats = false
+
+    @Option(name: .customLong("stats-format"), help: "Format of the compiler statistics.")
+    var statsFormat: CompileStatsFormat = .table
+
+    @Flag(
+        name: .customLong("heap-profile"),
+        help: "Build the program with the allocation-site heap profiler enabled.")
+    var heapProfile = false
+
+    @Option(
+        name: .customLong("heap-limit"),
+        help:
+            "Maximum heap size in bytes of the built program (0 means unlimited). The AJISAI_HEAP_LIMIT environment variable overrides it at run time."
+    )
+    var heapLimit: UInt?
+
+    @Option(
+        name: .customLong("heap-layout"),
+        help: "Heap layout of the built program's garbage collector.")
+    var heapLayout: HeapLayout = .treadmill
+
     mutating func run() throws {
+        var stats = CompileStats(isEnabled: showStats)
+
         let currentDirURL = URL(string: "file://\(FileManager.default.currentDirectoryPath)")!
         var inputFileURL = currentDirURL
         inputFileURL.appendPathComponent(inputFile)
@@ -39,18 +74,28 @@ struct Ajisai: ParsableCommand {
         }
 
         // 構文解析
-        let ast = try parseFile(srcURL: inputFileURL, srcContent: srcContent).get()
+        let lexer = AjisaiLexer(srcURL: inputFileURL, srcContent: srcContent)
+        let ast = try stats.measure(phase: "parse") {
+            try AjisaiParser(lexer: lexer).parse().get()
+        }
 
         // 意味解析
-        let analyzedAst = try semanticAnalyze(modDeclare: ast).get()
+        let analyzedAst = try stats.measure(phase: "semantic analysis") {
+            try semanticAnalyze(modDeclare: ast).get()
+        }
 
         let destDirPath = "ajisai-out"
         let runtimePath = "runtime"
         var fileOutputStream = try prepareDestFile(
             destDirPath: destDirPath, runtimePath: runtimePath)
 
-        // コード生成（C のソースコードを出力）
-        codeGenerate(analyzedAst: analyzedAst, to: &fileOutputStream)
+        // コード生成（ACIR を生成し、C のソースコードを出力）
+        let acProgram = stats.measure(phase: "codegen") {
+            AjisaiCodeGenerator(importGraph: analyzedAst, heapProfile: heapProfile).codegen()
+        }
+        stats.measure(phase: "C emission") {
+            writeCSource(program: acProgram, to: &fileOutputStream)
+        }
 
         var outputFileURL = currentDirURL
         var outputFileName = inputFileURL.lastPathComponent
@@ -59,8 +104,20 @@ struct Ajisai: ParsableCommand {
         let outputFilePath = outputFile ?? outputFileURL.path
 
         // 出力した C ソースコードのコンパイル
-        cc(outputFilePath: outputFilePath, destDirPath: destDirPath, runtimePath: runtimePath)
+        stats.measure(phase: "cc", children: true) {
+            cc(outputFilePath: outputFilePath, destDirPath: destDirPath, runtimePath: runtimePath)
+        }
+
+        if showStats {
+            stats.tokenCount = lexer.tokenCount
+            stats.astNodeCount = countAstNodes(modDeclare: ast)
+            stats.moduleCount = countModules(modDeclare: ast)
+            stats.acirInstructionCount = countInstructions(program: acProgram)
+            stats.generatedCBytes = fileOutputStream.bytesWritten
 
+            var stderrStream = FileOutputStream(fileHandle: FileHandle.standardError)
+            stats.report(format: statsFormat, to: &stderrStream)
+        }
     }
 
     func prepareDestFile(destDirPath: String, runtimePath: String) throws -> FileOutputStream {
@@ -89,6 +146,16 @@ struct Ajisai: ParsableCommand {
             "-o", outputFilePath, "-I./\(runtimePath)", "\(destDirPath)/main.c",
             "\(runtimePath)/ajisai_runtime.c",
         ]
+        if heapProfile {
+            // サンプリングの間隔と重みの計算に libm の log / exp を使う
+            cc.arguments!.append(contentsOf: ["-DAJISAI_HEAP_PROFILE", "-lm"])
+        }
+        if let heapLimit {
+            cc.arguments!.append("-DAJISAI_HEAP_LIMIT=\(heapLimit)")
+        }
+        if heapLayout == .bitmap {
+            cc.arguments!.append("-DAJISAI_BITMAP_HEAP")
+        }
 
         let stdoutPipe = Pipe()
         cc.standardOutput = stdoutPipe
@@ -107,5 +174,6 @@ struct Ajisai: ParsableCommand {
             print(err, terminator: "", to: &stderrStream)
         }
 
+        cc.waitUntilExit()
     }
 }
@@ -1,54 +1,68 @@
+import AjisaiParser
 import AjisaiSemanticAnalyzer
 
 //
 // ACIR -- Ajisai-C Intermediate Representation
 //
+// 識別子（変数名・関数名・モジュール名）は字句解析時に intern された AjisaiSymbol のまま保持し、
+// テキストへの解決は CSourceWriter で C ソースを出力する時に行う
+//
 
 // プログラム全体
 public struct ACProgram {
     public let decls: [ACDeclInst]
     public let funcDefs: [ACDefInst]
     public let modInitDefs: [ACModInitDefInst]
-    public let entryModName: String
+    public let entryModName: AjisaiSymbol
     public let globalRootTableSize: UInt
+    // ヒーププロファイル有効時のアロケーションサイトの一覧（無効時は nil）
+    // 添字がアロケーションサイト ID に対応する。ID 0 は不明なサイトとして予約されている
+    public let allocSites: [ACAllocSite]?
+}
+
+// ヒーププロファイルで使用する、オブジェクトを確保しうる式の位置情報
+public struct ACAllocSite {
+    public let funcName: String
+    public let location: String
 }
 
 public enum ACDeclInst {
     // モジュールレベル関数のプロトタイプ宣言
     case func_decl(
-        funcName: String, params: [(name: String, ty: AjisaiType)], returnTy: AjisaiType,
-        modName: String)
+        funcName: AjisaiSymbol, params: [(name: AjisaiSymbol, ty: AjisaiType)],
+        returnTy: AjisaiType, modName: AjisaiSymbol)
     // クロージャ本体のプロトタイプ宣言
     case closure_decl(
-        funcName: String, params: [(name: String, ty: AjisaiType)], returnTy: AjisaiType)
+        funcName: AjisaiSymbol, params: [(name: AjisaiSymbol, ty: AjisaiType)],
+        returnTy: AjisaiType)
     // モジュールレベル変数の未初期化状態の定義（実際には宣言ではない）
-    case val_decl(varName: String, ty: AjisaiType, modName: String)
+    case val_decl(varName: AjisaiSymbol, ty: AjisaiType, modName: AjisaiSymbol)
 }
 
 public enum ACDefInst {
     // モジュールレベル関数の定義
     case func_def(
-        funcName: String, params: [(name: String, ty: AjisaiType)], returnTy: AjisaiType,
-        modName: String, envId: UInt, body: [ACFuncBodyInst])
+        funcName: AjisaiSymbol, params: [(name: AjisaiSymbol, ty: AjisaiType)],
+        returnTy: AjisaiType, modName: AjisaiSymbol, envId: UInt, body: [ACFuncBodyInst])
     // クロージャ本体の定義
     case closure_def(
-        funcName: String, params: [(name: String, ty: AjisaiType)], returnTy: AjisaiType,
-        envId: UInt, body: [ACFuncBodyInst])
+        funcName: AjisaiSymbol, params: [(name: AjisaiSymbol, ty: AjisaiType)],
+        returnTy: AjisaiType, envId: UInt, body: [ACFuncBodyInst])
 }
 
 // モジュール初期化関数の定義命令
 public struct ACModInitDefInst {
     public let body: [ACModInitBodyInst]
-    public let modName: String
+    public let modName: AjisaiSymbol
 }
 
 public enum ACModInitBodyInst {
     // モジュール初期化関数を実行する命令
-    case mod_init(modName: String)
+    case mod_init(modName: AjisaiSymbol)
     // モジュールレベル変数を初期化する命令
-    case modval_init(varName: String, modName: String, value: ACValueInst)
+    case modval_init(varName: AjisaiSymbol, modName: AjisaiSymbol, value: ACValueInst)
     // モジュールレベル変数をグローバルのルート集合のテーブルに追加する命令
-    case global_roottable_reg(idx: UInt, varName: String, modName: String)
+    case global_roottable_reg(idx: UInt, varName: AjisaiSymbol, modName: AjisaiSymbol)
     // その他、関数内の一般的な命令
     case func_body_inst(ACFuncBodyInst)
 }
@@ -57,6 +71,10 @@ public enum ACFuncBodyInst {
     // 関数先頭で作成する関数フレーム情報を初期化する命令
     case funcframe_init(rootTableSize: UInt)
 
+    // 直後のオブジェクト確保のアロケーションサイト ID を関数フレームに設定する命令
+    // （ヒーププロファイル有効時のみ発行される）
+    case alloc_site_set(id: UInt)
+
     // ルート集合のテーブルに関連する命令
     case roottable_init(size: UInt)
     case roottable_reg(envId: UInt, rootTableIdx: UInt, tmpVarIdx: UInt)
@@ -68,12 +86,13 @@ public enum ACFuncBodyInst {
     case tmp_store(envId: UInt, tmpVarIdx: UInt, value: ACValueInst)
 
     // ローカル変数の定義
-    case envvar_def(envId: UInt, varName: String, ty: AjisaiType, value: ACValueInst)
+    case envvar_def(envId: UInt, varName: AjisaiSymbol, ty: AjisaiType, value: ACValueInst)
 
     // 静的領域に文字列オブジェクトを作成する命令
     case str_make_static(id: UInt, value: String, len: UInt)
     // 静的領域にクロージャオブジェクトを作成する命令
-    case closure_make_static(id: UInt, funcKind: AjisaiFuncKind, name: String, modName: String?)
+    case closure_make_static(
+        id: UInt, funcKind: AjisaiFuncKind, name: AjisaiSymbol, modName: AjisaiSymbol?)
 
     // if (...) { ... } else { ... }
     case ifelse(cond: ACValueInst, then: [ACFuncBodyInst], els: [ACFuncBodyInst])
@@ -82,15 +101,18 @@ public enum ACFuncBodyInst {
     // 想定される命令は func_call および closure_call
     case discard_value(ACValueInst)
 
+    // 関数から戻る直前に、呼び出し元のフレームのルートが未走査であれば走査する命令（リターンバリア）
+    case funcframe_leave
+
     // 関数から return する命令
     case func_return(value: ACValueInst)
 }
 
 public enum ACValueInst {
     // 変数参照命令
-    case builtin_load(name: String)  // 組み込み関数名
-    case modval_load(modName: String, varName: String)  // モジュールレベル変数名
-    case envvar_load(envId: UInt, varName: String)  // ローカル変数名
+    case builtin_load(name: AjisaiSymbol)  // 組み込み関数名
+    case modval_load(modName: AjisaiSymbol, varName: AjisaiSymbol)  // モジュールレベル変数名
+    case envvar_load(envId: UInt, varName: AjisaiSymbol)  // ローカル変数名
     case tmp_load(envId: UInt, index: UInt)  // 一時変数名
 
     // 関数呼び出し命令
@@ -1,17 +1,37 @@
+import AjisaiParser
 import AjisaiSemanticAnalyzer
 import Foundation
 
 enum ModuleInitItem {
     case exprStmt(expr: AjisaiExpr)
-    case importMod(modName: String)
+    case importMod(modName: AjisaiSymbol)
     case valDef(declare: AjisaiVariableDeclare)
 }
 
+// ヒーププロファイル用に、プログラム全体のアロケーションサイトに ID を割り当てる
+final class AllocSiteTable {
+    var sites: [ACAllocSite] = [ACAllocSite(funcName: "<unknown>", location: "<unknown>")]
+    let locator = AjisaiSourceLocator()
+
+    func register(funcName: String, span: AjisaiSpan?) -> UInt {
+        let location = span.map { span in locator.location(of: span) } ?? "<unknown>"
+        sites.append(ACAllocSite(funcName: funcName, location: location))
+        return UInt(sites.count - 1)
+    }
+}
+
 public final class AjisaiCodeGenerator {
     let importGraph: AjisaiImportGraphNode<AjisaiModule>
+    let allocSites: AllocSiteTable?
+
+    public init(importGraph: AjisaiImportGraphNode<AjisaiModule>, heapProfile: Bool = false) {
+        self.importGraph = importGraph
+        self.allocSites = heapProfile ? AllocSiteTable() : nil
+    }
 
-    public init(importGraph: AjisaiImportGraphNode<AjisaiModule>) {
+    init(importGraph: AjisaiImportGraphNode<AjisaiModule>, allocSites: AllocSiteTable?) {
         self.importGraph = importGraph
+        self.allocSites = allocSites
     }
 
     public func codegen() -> ACProgram {
@@ -22,7 +42,8 @@ public final class AjisaiCodeGenerator {
             funcDefs: subModCode.funcDefs,
             modInitDefs: subModCode.modInitDefs,
             entryModName: importGraph.modName.renamed,
-            globalRootTableSize: importGraph.mod.globalRootTableSize)
+            globalRootTableSize: importGraph.mod.globalRootTableSize,
+            allocSites: allocSites?.sites)
     }
 
     struct SubmoduleCode {
@@ -36,10 +57,10 @@ public final class AjisaiCodeGenerator {
         var funcDefs: [ACDefInst] = []
         var modInitDefs: [ACModInitDefInst] = []
 
-        var modInitsNumMap: [String: (renamed: String, initsNum: Int)] = [:]
+        var modInitsNumMap: [AjisaiSymbol: (renamed: AjisaiSymbol, initsNum: Int)] = [:]
 
         for (importModName, importNode) in importGraph.importMods {
-            let subCodeGen = AjisaiCodeGenerator(importGraph: importNode)
+            let subCodeGen = AjisaiCodeGenerator(importGraph: importNode, allocSites: allocSites)
             let subModCode = subCodeGen.codegenModule()
 
             modInitsNumMap[importModName] = (
@@ -66,7 +87,7 @@ public final class AjisaiCodeGenerator {
                 switch declare.value {
                 case let .funcNode(
                     args: args, body: body, bodyTy: bodyTy, ty: _, envId: envId,
-                    rootTableSize: rootTableSize, closureId: closureId, rootIdx: _):
+                    rootTableSize: rootTableSize, closureId: closureId, rootIdx: _, span: _):
 
                     let funcCodeGen = FuncCodeGenerator(
                         funcName: declare.name,
@@ -76,7 +97,8 @@ public final class AjisaiCodeGenerator {
                         body: body,
                         envId: envId,
                         rootTableSize: rootTableSize,
-                        closureId: closureId)
+                        closureId: closureId,
+                        allocSites: allocSites)
 
                     let (funcDecl, funcDef) = funcCodeGen.codegen()
                     decls.append(funcDecl)
@@ -95,7 +117,8 @@ public final class AjisaiCodeGenerator {
         if modInitItems.count > 0 {
             let modInitCodegen = ModInitCodeGenerator(
                 modName: importGraph.modName.renamed, envId: importGraph.mod.envId,
-                rootTableSize: importGraph.mod.rootTableSize, items: modInitItems)
+                rootTableSize: importGraph.mod.rootTableSize, items: modInitItems,
+                allocSites: allocSites)
             modInitDefs.append(modInitCodegen.codegen())
         }
 
@@ -104,25 +127,32 @@ public final class AjisaiCodeGenerator {
 }
 
 final class FuncContext {
-    let funcName: String
+    let funcName: AjisaiSymbol
     var funcEnvId: UInt
     var tmpId: UInt = 0
 
+    // ヒーププロファイル有効時のみ非 nil
+    let allocSites: AllocSiteTable?
+    // アロケーションサイトの表示に使う関数名
+    let siteFuncName: String
+
     var freshFuncTmpId: UInt {
         let id = tmpId
         tmpId += 1
         return id
     }
 
-    init(funcName: String, envId: UInt) {
+    init(funcName: AjisaiSymbol, envId: UInt, siteFuncName: String, allocSites: AllocSiteTable?) {
         self.funcName = funcName
         self.funcEnvId = envId
+        self.siteFuncName = siteFuncName
+        self.allocSites = allocSites
     }
 }
 
 final class FuncCodeGenerator {
     let funcCtx: FuncContext
-    let modName: String
+    let modName: AjisaiSymbol
 
     let bodyType: AjisaiType
 
@@ -133,8 +163,8 @@ final class FuncCodeGenerator {
     let closureId: UInt?
 
     init(
-        funcName: String,
-        modName: String,
+        funcName: AjisaiSymbol,
+        modName: AjisaiSymbol,
 
         bodyType: AjisaiType,
 
@@ -142,9 +172,20 @@ final class FuncCodeGenerator {
         body: AjisaiExpr,
         envId: UInt,
         rootTableSize: UInt,
-        closureId: UInt?
+        closureId: UInt?,
+        allocSites: AllocSiteTable?
     ) {
-        self.funcCtx = FuncContext(funcName: funcName, envId: envId)
+        // アロケーションサイトの表示名は、ヒーププロファイル有効時にのみテキストへ解決する
+        let siteFuncName =
+            if allocSites == nil {
+                ""
+            } else if closureId == nil {
+                "\(modName)::\(funcName)"
+            } else {
+                "\(modName)::closure_\(funcName)"
+            }
+        self.funcCtx = FuncContext(
+            funcName: funcName, envId: envId, siteFuncName: siteFuncName, allocSites: allocSites)
         self.modName = modName
 
         self.bodyType = bodyType
@@ -199,12 +240,33 @@ final class FuncCodeGenerator {
             bodyInsts.append(contentsOf: prelude)
         }
 
+        // 戻り値の評価中に GC サイクルが始まりうるため、リターンバリアは戻り値を評価した後に通す
         if let valInst = valInst {
+            let mayAllocate =
+                switch valInst {
+                case .builtin_load, .modval_load, .envvar_load, .tmp_load, .i32_const, .bool_const,
+                    .str_const, .closure_const:
+                    false
+                default:
+                    true
+                }
             if bodyType.tyEqual(to: .unit) {
                 bodyInsts.append(.discard_value(valInst))
-            } else {
+                bodyInsts.append(.funcframe_leave)
+            } else if !mayAllocate {
+                bodyInsts.append(.funcframe_leave)
                 bodyInsts.append(.func_return(value: valInst))
+            } else {
+                let tmpId = funcCtx.freshFuncTmpId
+                bodyInsts.append(
+                    .tmp_def(
+                        envId: funcCtx.funcEnvId, tmpVarIdx: tmpId, ty: bodyType, value: valInst))
+                bodyInsts.append(.funcframe_leave)
+                bodyInsts.append(
+                    .func_return(value: .tmp_load(envId: funcCtx.funcEnvId, index: tmpId)))
             }
+        } else {
+            bodyInsts.append(.funcframe_leave)
         }
 
         return bodyInsts
@@ -212,18 +274,23 @@ final class FuncCodeGenerator {
 }
 
 final class ModInitCodeGenerator {
-    let modName: String
+    let modName: AjisaiSymbol
     let rootTableSize: UInt
     let items: [ModuleInitItem]
 
     let funcCtx: FuncContext
 
-    init(modName: String, envId: UInt, rootTableSize: UInt, items: [ModuleInitItem]) {
+    init(
+        modName: AjisaiSymbol, envId: UInt, rootTableSize: UInt, items: [ModuleInitItem],
+        allocSites: AllocSiteTable?
+    ) {
         self.modName = modName
         self.rootTableSize = rootTableSize
         self.items = items
 
-        self.funcCtx = FuncContext(funcName: "", envId: envId)
+        self.funcCtx = FuncContext(
+            funcName: .empty, envId: envId,
+            siteFuncName: allocSites == nil ? "" : "\(modName)::<init>", allocSites: allocSites)
     }
 
     func codegen() -> ACModInitDefInst {
@@ -310,6 +377,7 @@ final class ModInitCodeGenerator {
                 }
             }
         }
+        bodyInsts.append(.func_body_inst(.funcframe_leave))
 
         return bodyInsts
     }
@@ -328,14 +396,17 @@ final class ExprCodeGenerator {
             return codegenExprSeq(exprs: exprs, ty: ty)
         case let .funcNode(
             args: _, body: _, bodyTy: _, ty: ty, envId: _, rootTableSize: _, closureId: closureId,
-            rootIdx: rootIdx):
-            return codegenClosure(closureId: closureId!, ty: ty, rootIdx: rootIdx!)
+            rootIdx: rootIdx, span: span):
+            return codegenClosure(closureId: closureId!, ty: ty, rootIdx: rootIdx!, span: span)
         case let .unaryNode(opKind: opKind, operand: operand, ty: _):
             return codegenUnary(op: opKind, operand: operand)
-        case let .binaryNode(opKind: opKind, left: left, right: right, ty: _, rootIdx: rootIdx):
-            return codegenBinary(op: opKind, left: left, right: right, rootIdx: rootIdx)
-        case let .callNode(callee: callee, args: args, ty: _, calleeTy: calleeTy, rootIdx: rootIdx):
-            return codegenCall(callee: callee, calleeTy: calleeTy, args: args, rootIdx: rootIdx)
+        case let .binaryNode(
+            opKind: opKind, left: left, right: right, ty: _, rootIdx: rootIdx, span: span):
+            return codegenBinary(op: opKind, left: left, right: right, rootIdx: rootIdx, span: span)
+        case let .callNode(
+            callee: callee, args: args, ty: _, calleeTy: calleeTy, rootIdx: rootIdx, span: span):
+            return codegenCall(
+                callee: callee, calleeTy: calleeTy, args: args, rootIdx: rootIdx, span: span)
         case let .letNode(
             declares: declares, body: body, bodyTy: bodyTy, envId: envId, rootIdx: rootIdx,
             rootIndices: rootIndices):
@@ -375,7 +446,9 @@ final class ExprCodeGenerator {
         }
     }
 
-    func codegenBinary(op: AjisaiBinOp, left: AjisaiExpr, right: AjisaiExpr, rootIdx: UInt?) -> (
+    func codegenBinary(
+        op: AjisaiBinOp, left: AjisaiExpr, right: AjisaiExpr, rootIdx: UInt?, span: AjisaiSpan?
+    ) -> (
         prelude: [ACFuncBodyInst]?, valInst: ACValueInst?
     ) {
         let (leftPrelude, leftValInst) = codegen(expr: left)
@@ -398,7 +471,7 @@ final class ExprCodeGenerator {
             let rightTy = right.ty
             if leftTy.tyEqual(to: .str) && rightTy.tyEqual(to: .str) {
                 let tmpId = funcCtx.freshFuncTmpId
-                var prelude1: [ACFuncBodyInst] = []
+                var prelude1: [ACFuncBodyInst] = allocSitePrelude(span: span)
                 prelude1.append(
                     .tmp_def(
                         envId: funcCtx.funcEnvId, tmpVarIdx: tmpId, ty: .str,
@@ -491,7 +564,10 @@ final class ExprCodeGenerator {
         }
     }
 
-    func codegenCall(callee: AjisaiExpr, calleeTy: AjisaiType, args: [AjisaiExpr], rootIdx: UInt?)
+    func codegenCall(
+        callee: AjisaiExpr, calleeTy: AjisaiType, args: [AjisaiExpr], rootIdx: UInt?,
+        span: AjisaiSpan?
+    )
         -> (
             prelude: [ACFuncBodyInst]?, valInst: ACValueInst?
         )
@@ -551,6 +627,7 @@ final class ExprCodeGenerator {
 
             if bodyType.mayBeHeapObject() {
                 let tmpId = funcCtx.freshFuncTmpId
+                prelude.append(contentsOf: allocSitePrelude(span: span))
                 prelude.append(
                     .tmp_def(
                         envId: funcCtx.funcEnvId, tmpVarIdx: tmpId, ty: bodyType, value: valInst))
@@ -567,13 +644,13 @@ final class ExprCodeGenerator {
         }
     }
 
-    func codegenLocalVar(varName: String, envId: UInt) -> (
+    func codegenLocalVar(varName: AjisaiSymbol, envId: UInt) -> (
         prelude: [ACFuncBodyInst]?, valInst: ACValueInst?
     ) {
         (prelude: nil, valInst: .envvar_load(envId: envId, varName: varName))
     }
 
-    func codegenGlobalVar(varName: String, modName: String, ty: AjisaiType) -> (
+    func codegenGlobalVar(varName: AjisaiSymbol, modName: AjisaiSymbol, ty: AjisaiType) -> (
         prelude: [ACFuncBodyInst]?, valInst: ACValueInst?
     ) {
         switch ty {
@@ -734,9 +811,9 @@ final class ExprCodeGenerator {
         )
     }
 
-    func codegenStaticClosure(name: String, funcKind: AjisaiFuncKind, modName: String) -> (
-        prelude: [ACFuncBodyInst], valInst: ACValueInst
-    ) {
+    func codegenStaticClosure(
+        name: AjisaiSymbol, funcKind: AjisaiFuncKind, modName: AjisaiSymbol
+    ) -> (prelude: [ACFuncBodyInst], valInst: ACValueInst) {
         let closureId = funcCtx.freshFuncTmpId
         return (
             prelude: [
@@ -748,14 +825,14 @@ final class ExprCodeGenerator {
         )
     }
 
-    func codegenClosure(closureId: UInt, ty: AjisaiType, rootIdx: UInt) -> (
+    func codegenClosure(closureId: UInt, ty: AjisaiType, rootIdx: UInt, span: AjisaiSpan?) -> (
         prelude: [ACFuncBodyInst]?, valInst: ACValueInst?
     ) {
         let funcEnvId = funcCtx.funcEnvId
         let tmpVarId = funcCtx.freshFuncTmpId
 
         return (
-            prelude: [
+            prelude: allocSitePrelude(span: span) + [
                 .tmp_def(
                     envId: funcEnvId, tmpVarIdx: tmpVarId, ty: ty,
                     value: .closure_make(id: closureId)),
@@ -764,13 +841,25 @@ final class ExprCodeGenerator {
             valInst: .tmp_load(envId: funcEnvId, index: tmpVarId)
         )
     }
+
+    // オブジェクトを確保しうる値を一時変数に代入する直前に置く、アロケーションサイトの設定命令を返す
+    // （引数中の関数呼び出しはそれぞれ自身の関数フレームを持つので、設定した ID が上書きされることはない）
+    func allocSitePrelude(span: AjisaiSpan?) -> [ACFuncBodyInst] {
+        guard let allocSites = funcCtx.allocSites else {
+            return []
+        }
+        return [
+            .alloc_site_set(id: allocSites.register(funcName: funcCtx.siteFuncName, span: span))
+        ]
+    }
 }
 
 public func codeGenerate<Target>(
-    analyzedAst: AjisaiImportGraphNode<AjisaiModule>, to target: inout Target
+    analyzedAst: AjisaiImportGraphNode<AjisaiModule>, heapProfile: Bool = false,
+    to target: inout Target
 )
 where Target: TextOutputStream {
-    let codeGenerator = AjisaiCodeGenerator(importGraph: analyzedAst)
+    let codeGenerator = AjisaiCodeGenerator(importGraph: analyzedAst, heapProfile: heapProfile)
     let acProgram = codeGenerator.codegen()
     writeCSource(program: acProgram, to: &target)
 }
@@ -1,3 +1,4 @@
+import AjisaiParser
 import AjisaiSemanticAnalyzer
 import Foundation
 
@@ -5,6 +6,7 @@ let defaultFileHeader = "#include <ajisai_runtime.h>\n\n"
 
 typealias WriteFunc = (String) -> Void
 
+// ACIR 中の識別子（AjisaiSymbol）は、ここでの文字列補間で初めてテキストに解決される
 public func writeCSource<Target>(program: ACProgram, to target: inout Target)
 where Target: TextOutputStream {
     func write(_ str: String) {
@@ -23,6 +25,10 @@ where Target: TextOutputStream {
         write("\nstatic AjisaiObject *global_root_table[\(program.globalRootTableSize)] = {};\n")
     }
 
+    if let allocSites = program.allocSites {
+        writeAllocSites(write: write, allocSites: allocSites)
+    }
+
     program.funcDefs.forEach { funcDef in
         write("\n")
         writeFuncDef(write: write, def: funcDef)
@@ -51,8 +57,8 @@ func writeDecl(write: WriteFunc, decl: ACDeclInst) {
 }
 
 func writeProtoType(
-    write: WriteFunc, funcName: String, params: [(name: String, ty: AjisaiType)],
-    returnTy: AjisaiType, modName: String?
+    write: WriteFunc, funcName: AjisaiSymbol, params: [(name: AjisaiSymbol, ty: AjisaiType)],
+    returnTy: AjisaiType, modName: AjisaiSymbol?
 ) {
     let prefix = if let modName = modName { "userdef__\(modName)_" } else { "closure" }
     write(
@@ -65,15 +71,41 @@ func writeProtoType(
     write(");\n")
 }
 
-func writeGlobalVar(write: WriteFunc, varName: String, ty: AjisaiType, modName: String) {
+func writeGlobalVar(
+    write: WriteFunc, varName: AjisaiSymbol, ty: AjisaiType, modName: AjisaiSymbol
+) {
     write("static \(ty.cRepresentation()) userdef__\(modName)__\(varName);\n")
 }
 
+func writeAllocSites(write: WriteFunc, allocSites: [ACAllocSite]) {
+    func cStringLiteral(_ str: String) -> String {
+        let escaped = str.replacingOccurrences(of: "\\", with: "\\\\")
+            .replacingOccurrences(of: "\"", with: "\\\"")
+        return "\"\(escaped)\""
+    }
+
+    write("\nstatic const AjisaiAllocSite alloc_sites[\(allocSites.count)] = {\n")
+    for site in allocSites {
+        write("  { \(cStringLiteral(site.funcName)), \(cStringLiteral(site.location)) },\n")
+    }
+    write("};\n")
+}
+
 func writeMain(write: WriteFunc, program: ACProgram) {
     write("int main() {\n")
     write("  AjisaiMemManager mem_manager;\n")
-    // TODO: メモリ確保に失敗した時に終了する処理を入れる
-    write("  ajisai_mem_manager_init(&mem_manager);\n")
+    write("  if (ajisai_mem_manager_init(&mem_manager) < 0) {\n")
+    write("    fprintf(stderr, \"error: failed to initialize memory manager\\n\");\n")
+    write("    return 1;\n")
+    write("  }\n")
+    if let allocSites = program.allocSites {
+        write(
+            "  if (ajisai_heap_profile_init(&mem_manager, alloc_sites, \(allocSites.count)) < 0) {\n")
+        write("    fprintf(stderr, \"error: failed to initialize heap profiler\\n\");\n")
+        write("    ajisai_mem_manager_deinit(&mem_manager);\n")
+        write("    return 1;\n")
+        write("  }\n")
+    }
 
     write(
         "  AjisaiFuncFrame func_frame = { .parent = NULL, .mem_manager = &mem_manager, .root_table_size = \(program.globalRootTableSize)"
@@ -114,10 +146,10 @@ func writeModInitDef(write: WriteFunc, modInit: ACModInitDefInst) {
 }
 
 func writeFuncDef(write: WriteFunc, def: ACDefInst) {
-    let funcName: String
-    let params: [(name: String, ty: AjisaiType)]
+    let funcName: AjisaiSymbol
+    let params: [(name: AjisaiSymbol, ty: AjisaiType)]
     let returnTy: AjisaiType
-    var modName: String? = nil
+    var modName: AjisaiSymbol? = nil
     let envId: UInt
     let body: [ACFuncBodyInst]
     switch def {
@@ -169,6 +201,10 @@ func writeFuncBodyInst(write: WriteFunc, funcBodyInst: ACFuncBodyInst) {
             write(", .root_table = root_table")
         }
         write(" };\n")
+    case let .alloc_site_set(id: siteId):
+        write("  func_frame.alloc_site = \(siteId);\n")
+    case .funcframe_leave:
+        write("  ajisai_func_frame_leave(&func_frame);\n")
     case let .func_return(value: value):
         write("  return \(writeValueInst(valInst: value));\n")
     case let .envvar_def(envId: envId, varName: varName, ty: ty, value: value):
@@ -18,7 +18,7 @@ public enum AjisaiModuleItemNode {
     case moduleNode(moduleDeclare: AjisaiModuleDeclareNode, span: AjisaiSpan? = nil)
     case valNode(declare: AjisaiTypedVariableDeclareNode)
     case funcNode(funcDef: AjisaiFuncDefNode)
-    case importNode(path: AjisaiPathNode, asName: String? = nil, span: AjisaiSpan? = nil)
+    case importNode(path: AjisaiPathNode, asName: AjisaiSymbol? = nil, span: AjisaiSpan? = nil)
     case exprStmtNode(expr: AjisaiExprNode, span: AjisaiSpan? = nil)
 
     public var span: AjisaiSpan? {
@@ -63,11 +63,11 @@ extension AjisaiModuleItemNode: Equatable {
 }
 
 public struct AjisaiModuleDeclareNode {
-    public let name: String
+    public let name: AjisaiSymbol
     public let mod: AjisaiModuleNode
     public let span: AjisaiSpan?
 
-    public init(name: String, mod: AjisaiModuleNode, span: AjisaiSpan? = nil) {
+    public init(name: AjisaiSymbol, mod: AjisaiModuleNode, span: AjisaiSpan? = nil) {
         self.name = name
         self.mod = mod
         self.span = span
@@ -81,13 +81,14 @@ extension AjisaiModuleDeclareNode: Equatable {
 }
 
 public struct AjisaiVariableDeclareNode {
-    public let name: String
+    public let name: AjisaiSymbol
     public let ty: AjisaiTypeNode?
     public let value: AjisaiExprNode
     public let span: AjisaiSpan?
 
     public init(
-        name: String, ty: AjisaiTypeNode? = nil, value: AjisaiExprNode, span: AjisaiSpan? = nil
+        name: AjisaiSymbol, ty: AjisaiTypeNode? = nil, value: AjisaiExprNode,
+        span: AjisaiSpan? = nil
     ) {
         self.name = name
         self.ty = ty
@@ -111,12 +112,14 @@ extension AjisaiVariableDeclareNode: Equatable {
 }
 
 public struct AjisaiTypedVariableDeclareNode {
-    public let name: String
+    public let name: AjisaiSymbol
     public let ty: AjisaiTypeNode
     public let value: AjisaiExprNode
     public let span: AjisaiSpan?
 
-    public init(name: String, ty: AjisaiTypeNode, value: AjisaiExprNode, span: AjisaiSpan? = nil) {
+    public init(
+        name: AjisaiSymbol, ty: AjisaiTypeNode, value: AjisaiExprNode, span: AjisaiSpan? = nil
+    ) {
         self.name = name
         self.ty = ty
         self.value = value
@@ -134,11 +137,11 @@ extension AjisaiTypedVariableDeclareNode: Equatable {
 }
 
 public struct AjisaiFuncDefNode {
-    public let name: String
+    public let name: AjisaiSymbol
     public let value: AjisaiExprNode
     public let span: AjisaiSpan?
 
-    public init(name: String, value: AjisaiExprNode, span: AjisaiSpan? = nil) {
+    public init(name: AjisaiSymbol, value: AjisaiExprNode, span: AjisaiSpan? = nil) {
         self.name = name
         self.value = value
         self.span = span
@@ -152,8 +155,8 @@ extension AjisaiFuncDefNode: Equatable {
 }
 
 public enum AjisaiPathNode {
-    case pathEnd(name: String, span: AjisaiSpan? = nil)
-    indirect case path(sup: String, sub: AjisaiPathNode, supSpan: AjisaiSpan? = nil)
+    case pathEnd(name: AjisaiSymbol, span: AjisaiSpan? = nil)
+    indirect case path(sup: AjisaiSymbol, sub: AjisaiPathNode, supSpan: AjisaiSpan? = nil)
 
     public var span: AjisaiSpan? {
         var span: AjisaiSpan? = nil
@@ -188,7 +191,7 @@ public enum AjisaiPathNode {
         }
     }
 
-    public func lastName() -> String {
+    public func lastName() -> AjisaiSymbol {
         switch self {
         case let .pathEnd(name: name, span: _):
             return name
@@ -234,7 +237,7 @@ public enum AjisaiExprNode {
         exprs: [AjisaiExprNode],
         span: AjisaiSpan? = nil)
     indirect case fnExprNode(
-        args: [(name: String, ty: AjisaiTypeNode?, span: AjisaiSpan?)],
+        args: [(name: AjisaiSymbol, ty: AjisaiTypeNode?, span: AjisaiSpan?)],
         body: AjisaiExprNode,
         bodyTy: AjisaiTypeNode? = nil,
         span: AjisaiSpan? = nil)
@@ -263,7 +266,7 @@ public enum AjisaiExprNode {
     case boolNode(value: Bool, span: AjisaiSpan? = nil)
     case integerNode(value: UInt, span: AjisaiSpan? = nil)
     case stringNode(value: String, span: AjisaiSpan? = nil)
-    case variableNode(name: String, span: AjisaiSpan? = nil)
+    case variableNode(name: AjisaiSymbol, span: AjisaiSpan? = nil)
     case pathNode(AjisaiPathNode)
     case unitNode(span: AjisaiSpan? = nil)
 
@@ -418,7 +421,7 @@ public enum AjisaiTypeNode: Equatable {
         }
     }
 
-    public static func convertToPrimitiveType(from ident: String) -> AjisaiTypeNode? {
+    public static func convertToPrimitiveType(from ident: AjisaiSymbol) -> AjisaiTypeNode? {
         switch ident {
         case "i32":
             return .i32
@@ -28,6 +28,50 @@ public struct AjisaiSpan: Equatable, Sendable {
         let newEnd = other.end < end ? end : other.end
         return AjisaiSpan(start: newStart, end: newEnd, srcURL: srcURL, srcContent: srcContent)
     }
+
+}
+
+// スパンの開始位置を "ファイル名:行:列" の形式で表す（行・列は 1 始まり）。
+// ソースファイルごとに行頭の位置の表を一度だけ作り、行は二分探索で求める
+public final class AjisaiSourceLocator {
+    private var lineStartsTable: [URL: [String.Index]] = [:]
+
+    public init() {}
+
+    public func location(of span: AjisaiSpan) -> String {
+        let lineStarts = lineStarts(srcURL: span.srcURL, srcContent: span.srcContent)
+
+        // span.start 以前で最後の行頭を探す
+        var low = 0
+        var high = lineStarts.count
+        while high - low > 1 {
+            let mid = (low + high) / 2
+            if lineStarts[mid] <= span.start {
+                low = mid
+            } else {
+                high = mid
+            }
+        }
+        let column = span.srcContent.distance(from: lineStarts[low], to: span.start) + 1
+        return "\(span.srcURL.lastPathComponent):\(low + 1):\(column)"
+    }
+
+    private func lineStarts(srcURL: URL, srcContent: String) -> [String.Index] {
+        if let lineStarts = lineStartsTable[srcURL] {
+            return lineStarts
+        }
+        var lineStarts = [srcContent.startIndex]
+        var idx = srcContent.startIndex
+        while idx < srcContent.endIndex {
+            let next = srcContent.index(after: idx)
+            if srcContent[idx].isNewline {
+                lineStarts.append(next)
+            }
+            idx = next
+        }
+        lineStartsTable[srcURL] = lineStarts
+        return lineStarts
+    }
 }
 
 public final class AjisaiLexer {
@@ -38,6 +82,8 @@ public final class AjisaiLexer {
     private var peekError: AjisaiLexerError? = nil
     private var peekStart: String.Index
     private var peekEnd: String.Index
+    // nextToken が正常に返したトークンの数（コンパイル統計用）
+    public private(set) var tokenCount: Int = 0
 
     public init(srcURL: URL, srcContent: String) {
         self.srcURL = srcURL
@@ -162,7 +208,7 @@ public final class AjisaiLexer {
         case "val":
             return .val
         default:
-            return .ident(String(str))
+            return .ident(AjisaiSymbol(String(str)))
         }
     }
 
@@ -367,6 +413,10 @@ public final class AjisaiLexer {
 
         peekEnd = curPos
 
+        if case .success = curTokenAndSpan {
+            tokenCount += 1
+        }
+
         return curTokenAndSpan
     }
 
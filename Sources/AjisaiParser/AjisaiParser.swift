@@ -23,7 +23,7 @@ public final class AjisaiParser {
     public func parse() -> ParseResult<AjisaiModuleDeclareNode> {
         let modName = lexer.srcURL.deletingPathExtension().lastPathComponent
         return parseModule(isSubMod: false).map { mod in
-            AjisaiModuleDeclareNode(name: modName, mod: mod)
+            AjisaiModuleDeclareNode(name: AjisaiSymbol(modName), mod: mod)
         }
     }
 
@@ -63,7 +63,7 @@ public final class AjisaiParser {
 
             // module definition
             if let module = eat(.module) {
-                switch expect(.ident("")) {
+                switch expect(.ident(.empty)) {
                 case let .failure(error):
                     return .failure(error)
                 case let .success((token: name, span: nameSpan)):
@@ -137,7 +137,7 @@ public final class AjisaiParser {
 
     func parseValDef(startSpan: AjisaiSpan) -> ParseResult<AjisaiTypedVariableDeclareNode> {
         parseValDeclare(startSpan: startSpan) {
-            (name: String, ty: AjisaiTypeNode?, value: AjisaiExprNode, span: AjisaiSpan?)
+            (name: AjisaiSymbol, ty: AjisaiTypeNode?, value: AjisaiExprNode, span: AjisaiSpan?)
                 -> ParseResult<AjisaiTypedVariableDeclareNode> in
             if let ty = ty {
                 .success(
@@ -153,7 +153,7 @@ public final class AjisaiParser {
     }
 
     func parseImport(startSpan: AjisaiSpan) -> ParseResult<AjisaiModuleItemNode> {
-        expect(.ident("")).flatMap {
+        expect(.ident(.empty)).flatMap {
             guard case let .ident(fstName) = $0.token else {
                 return .failure(.unreachable)
             }
@@ -169,7 +169,7 @@ public final class AjisaiParser {
             case let .failure(error):
                 return .failure(error)
             case let .success(path):
-                var asName: String? = nil
+                var asName: AjisaiSymbol? = nil
                 let modName = path.lastName()
                 // super や package と書いてインポートしている場合、
                 // それを本来のモジュール名の代わりにモジュール名として使用する
@@ -177,7 +177,7 @@ public final class AjisaiParser {
                     asName = modName
                 }
                 if eat(.as_) != nil {
-                    switch expect(.ident("")) {
+                    switch expect(.ident(.empty)) {
                     case let .failure(error):
                         return .failure(error)
                     case let .success((token: asNameToken, span: _)):
@@ -577,7 +577,7 @@ public final class AjisaiParser {
                 }
             ),
             (
-                .ident(""),
+                .ident(.empty),
                 {
                     (token, span) in
                     if case .ident(let name) = token {
@@ -669,15 +669,15 @@ public final class AjisaiParser {
         }
     }
 
-    func parsePath(firstIdent: String, startSpan: AjisaiSpan) -> ParseResult<AjisaiPathNode> {
-        expect(.ident("")).flatMap {
+    func parsePath(firstIdent: AjisaiSymbol, startSpan: AjisaiSpan) -> ParseResult<AjisaiPathNode> {
+        expect(.ident(.empty)).flatMap {
             guard case let .ident(subName) = $0.token else {
                 return .failure(.unreachable)
             }
             var expr: AjisaiPathNode = .path(
                 sup: firstIdent, sub: .pathEnd(name: subName, span: $0.span), supSpan: startSpan)
             while eat(.colon_colon) != nil {
-                switch expect(.ident("")) {
+                switch expect(.ident(.empty)) {
                 case let .failure(error):
                     return .failure(error)
                 case let .success((token: token, span: span)):
@@ -701,7 +701,7 @@ public final class AjisaiParser {
             if let val = eat(.val) {
                 let valDecResult = parseValDeclare(startSpan: val.span) {
                     (
-                        name: String, ty: AjisaiTypeNode?, value: AjisaiExprNode,
+                        name: AjisaiSymbol, ty: AjisaiTypeNode?, value: AjisaiExprNode,
                         span: AjisaiSpan?
                     )
                         -> ParseResult<AjisaiVariableDeclareNode> in
@@ -739,9 +739,9 @@ public final class AjisaiParser {
 
     func parseValDeclare<T>(
         startSpan: AjisaiSpan,
-        convertFn: (String, AjisaiTypeNode?, AjisaiExprNode, AjisaiSpan?) -> ParseResult<T>
+        convertFn: (AjisaiSymbol, AjisaiTypeNode?, AjisaiExprNode, AjisaiSpan?) -> ParseResult<T>
     ) -> ParseResult<T> {
-        expect(.ident("")).flatMap {
+        expect(.ident(.empty)).flatMap {
             if case .ident(let varName) = $0.token {
                 var ty: AjisaiTypeNode? = nil
                 if eat(.colon) != nil {
@@ -772,7 +772,7 @@ public final class AjisaiParser {
     }
 
     func parseFuncDef(startSpan: AjisaiSpan) -> ParseResult<AjisaiFuncDefNode> {
-        expect(.ident("")).flatMap { identResult in
+        expect(.ident(.empty)).flatMap { identResult in
             let name: AjisaiToken = identResult.token
             guard case let .ident(name) = name else {
                 return .failure(.unreachable)
@@ -802,7 +802,7 @@ public final class AjisaiParser {
 
     func parseFunc(startSpan: AjisaiSpan) -> ParseResult<AjisaiExprNode> {
         let funcNodeResult: ParseResult<AjisaiExprNode> = expect(.lparen).flatMap { _ in
-            var args: [(name: String, ty: AjisaiTypeNode?, span: AjisaiSpan?)] = []
+            var args: [(name: AjisaiSymbol, ty: AjisaiTypeNode?, span: AjisaiSpan?)] = []
             if eat(.rparen) == nil {
                 var alreadyReadRightParen: Bool = false
                 while true {
@@ -857,8 +857,10 @@ public final class AjisaiParser {
         return funcNodeResult
     }
 
-    func parseFuncArg() -> ParseResult<(name: String, ty: AjisaiTypeNode?, span: AjisaiSpan?)> {
-        expect(.ident("")).flatMap { identResult in
+    func parseFuncArg() -> ParseResult<
+        (name: AjisaiSymbol, ty: AjisaiTypeNode?, span: AjisaiSpan?)
+    > {
+        expect(.ident(.empty)).flatMap { identResult in
             guard case let .ident(name) = identResult.token else {
                 return .failure(.unreachable)
             }
@@ -923,7 +925,7 @@ public final class AjisaiParser {
 
             return .success(.function(argTypes: argTypes, bodyType: bodyType))
         } else {
-            switch expect(.ident("")) {
+            switch expect(.ident(.empty)) {
             case .failure(let error):
                 return .failure(error)
             case let .success((token: token, span: _)):
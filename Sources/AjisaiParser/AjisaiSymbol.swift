@@ -0,0 +1,68 @@
+import Foundation
+
+// 識別子を intern した結果の ID
+// 字句解析器が識別子トークンを作る時点で AjisaiSymbolTable.shared に登録される。以降の環境や ACIR では
+// 整数の比較・ハッシュだけで識別子の同一性を判定し、テキストに戻すのは C ソースの出力時（とエラー表示）に限る
+public struct AjisaiSymbol: Hashable, Sendable {
+    public let id: UInt32
+
+    fileprivate init(id: UInt32) {
+        self.id = id
+    }
+
+    public init(_ text: String) {
+        self = AjisaiSymbolTable.shared.intern(text)
+    }
+
+    public var text: String {
+        AjisaiSymbolTable.shared.text(of: self)
+    }
+
+    // 空文字列のシンボル（ID 0 に予約されている）。expect でトークンの種類だけを指定する際などに使う
+    public static let empty = AjisaiSymbol(id: 0)
+}
+
+extension AjisaiSymbol: ExpressibleByStringLiteral {
+    public init(stringLiteral value: String) {
+        self.init(value)
+    }
+}
+
+// 文字列補間ではテキストに解決される（CSourceWriter は補間で識別子を出力する）
+extension AjisaiSymbol: CustomStringConvertible, CustomDebugStringConvertible {
+    public var description: String {
+        text
+    }
+
+    public var debugDescription: String {
+        text.debugDescription
+    }
+}
+
+public final class AjisaiSymbolTable: @unchecked Sendable {
+    // コンパイラ全体で一つの表を共有する（テストは並行に実行されるので lock で保護する）
+    public static let shared = AjisaiSymbolTable()
+
+    private let lock = NSLock()
+    private var symbols: [String: AjisaiSymbol] = ["": .empty]
+    private var texts: [String] = [""]
+
+    // text に対応する AjisaiSymbol を返す。まだ登録されていなければ新しい ID を割り当てる
+    public func intern(_ text: String) -> AjisaiSymbol {
+        lock.lock()
+        defer { lock.unlock() }
+        if let symbol = symbols[text] {
+            return symbol
+        }
+        let symbol = AjisaiSymbol(id: UInt32(texts.count))
+        symbols[text] = symbol
+        texts.append(text)
+        return symbol
+    }
+
+    public func text(of symbol: AjisaiSymbol) -> String {
+        lock.lock()
+        defer { lock.unlock() }
+        return texts[Int(symbol.id)]
+    }
+}
@@ -15,7 +15,7 @@ public enum AjisaiToken: Equatable, Sendable {
     case logand, logor, bang  // and or not
 
     // リテラル
-    case ident(String)  // 識別子
+    case ident(AjisaiSymbol)  // 識別子
     case integer(UInt)  // 整数値
     case str(String)  // 文字列
 
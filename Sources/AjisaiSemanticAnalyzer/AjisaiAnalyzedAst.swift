@@ -1,3 +1,5 @@
+import AjisaiParser
+
 public struct AjisaiModule: Equatable {
     public let items: [AjisaiModuleItem]
     public let envId: UInt
@@ -7,20 +9,20 @@ public struct AjisaiModule: Equatable {
 
 public enum AjisaiModuleItem: Equatable {
     case variableDeclare(AjisaiVariableDeclare)
-    case importNode(asName: String)
+    case importNode(asName: AjisaiSymbol)
     case exprStmtNode(expr: AjisaiExpr)
 }
 
 public struct AjisaiVariableDeclare: Equatable {
-    public let name: String
+    public let name: AjisaiSymbol
     public let ty: AjisaiType
     public let value: AjisaiExpr
-    public let modName: String
+    public let modName: AjisaiSymbol
     public let globalRootIdx: UInt?
 }
 
 public struct AjisaiFuncArg: Equatable {
-    public let name: String
+    public let name: AjisaiSymbol
     public let ty: AjisaiType
 }
 
@@ -36,7 +38,8 @@ public enum AjisaiExpr: Equatable {
         envId: UInt,
         rootTableSize: UInt,
         closureId: UInt?,
-        rootIdx: UInt?)
+        rootIdx: UInt?,
+        span: AjisaiSpan? = nil)
     indirect case letNode(
         declares: [AjisaiVariableDeclare],
         body: AjisaiExpr,
@@ -54,13 +57,15 @@ public enum AjisaiExpr: Equatable {
         args: [AjisaiExpr],
         ty: AjisaiType,
         calleeTy: AjisaiType,
-        rootIdx: UInt?)
+        rootIdx: UInt?,
+        span: AjisaiSpan? = nil)
     indirect case binaryNode(
         opKind: AjisaiBinOp,
         left: AjisaiExpr,
         right: AjisaiExpr,
         ty: AjisaiType,
-        rootIdx: UInt?)
+        rootIdx: UInt?,
+        span: AjisaiSpan? = nil)
     indirect case unaryNode(
         opKind: AjisaiUnOp,
         operand: AjisaiExpr,
@@ -68,8 +73,8 @@ public enum AjisaiExpr: Equatable {
     case boolNode(value: Bool)
     case integerNode(value: UInt)
     case stringNode(value: String, len: UInt)
-    case localVarNode(name: String, envId: UInt, ty: AjisaiType)
-    case globalVarNode(name: String, modName: String, ty: AjisaiType)
+    case localVarNode(name: AjisaiSymbol, envId: UInt, ty: AjisaiType)
+    case globalVarNode(name: AjisaiSymbol, modName: AjisaiSymbol, ty: AjisaiType)
     case unitNode
 
     public var ty: AjisaiType {
@@ -84,7 +89,8 @@ public enum AjisaiExpr: Equatable {
             envId: _,
             rootTableSize: _,
             closureId: _,
-            rootIdx: _):
+            rootIdx: _,
+            span: _):
             ty
         case let .letNode(
             declares: _,
@@ -105,9 +111,10 @@ public enum AjisaiExpr: Equatable {
             args: _,
             ty: ty,
             calleeTy: _,
-            rootIdx: _):
+            rootIdx: _,
+            span: _):
             ty
-        case let .binaryNode(opKind: _, left: _, right: _, ty: ty, rootIdx: _):
+        case let .binaryNode(opKind: _, left: _, right: _, ty: ty, rootIdx: _, span: _):
             ty
         case let .unaryNode(opKind: _, operand: _, ty: ty):
             ty
@@ -1,3 +1,4 @@
+import AjisaiParser
 import AjisaiUtil
 
 enum AjisaiEnvKind: Equatable {
@@ -9,7 +10,7 @@ final class AjisaiEnv {
     public let parent: AjisaiEnv?
     public let envKind: AjisaiEnvKind
 
-    var variables: [String: AjisaiType] = [:]
+    var variables: [AjisaiSymbol: AjisaiType] = [:]
     var __rootIndices: [UInt] = []
     var rootIdState: AjisaiRef<UInt> = AjisaiRef(0)
 
@@ -44,26 +45,30 @@ final class AjisaiEnv {
         return freshId
     }
 
-    func getVarTy(name: String) -> (ty: AjisaiType, envKind: AjisaiEnvKind, envId: UInt)? {
-        let ty = variables[name]
-        if let ty = ty {
-            return (ty: ty, envKind: envKind, envId: envId)
-        } else if let parent = parent {
-            return parent.getVarTy(name: name)
-        } else {
-            return nil
+    // 識別子は字句解析時に intern 済みなので、各環境での検索は整数 ID のハッシュ・比較だけで済む
+    func getVarTy(name: AjisaiSymbol) -> (ty: AjisaiType, envKind: AjisaiEnvKind, envId: UInt)? {
+        var env: AjisaiEnv? = self
+        while let curEnv = env {
+            if let ty = curEnv.variables[name] {
+                return (ty: ty, envKind: curEnv.envKind, envId: curEnv.envId)
+            }
+            env = curEnv.parent
         }
+        return nil
     }
 
-    func addNewVarTy(name: String, ty: AjisaiType) {
+    func addNewVarTy(name: AjisaiSymbol, ty: AjisaiType) {
         variables[name] = ty
     }
 
-    func setVarTy(name: String, ty: AjisaiType) {
-        if variables[name] == nil {
-            parent?.setVarTy(name: name, ty: ty)
-        } else {
-            variables[name] = ty
+    func setVarTy(name: AjisaiSymbol, ty: AjisaiType) {
+        var env: AjisaiEnv? = self
+        while let curEnv = env {
+            if curEnv.variables[name] != nil {
+                curEnv.variables[name] = ty
+                return
+            }
+            env = curEnv.parent
         }
     }
 }
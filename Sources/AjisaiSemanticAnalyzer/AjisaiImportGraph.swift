@@ -1,18 +1,15 @@
 import AjisaiParser
 
 final class ModuleRenamer {
-    var prevModIdxs: [String: Int] = [:]
+    var prevModIdxs: [AjisaiSymbol: Int] = [:]
 
-    public func renameModule(name: String) -> String {
+    // リネーム後の名前もシンボルとして登録する（テキストに解決するのは C ソースの出力時）
+    public func renameModule(name: AjisaiSymbol) -> AjisaiSymbol {
         let idx = prevModIdxs[name]
-        if let idx = idx {
-            let nextIdx = idx + 1
-            prevModIdxs[name] = nextIdx
-            return "\(name)\(nextIdx)"
-        } else {
-            prevModIdxs[name] = 0
-            return "\(name)0"
-        }
+        let nextIdx = if let idx = idx { idx + 1 } else { 0 }
+        prevModIdxs[name] = nextIdx
+        let renamed = "\(name)\(nextIdx)"
+        return AjisaiSymbol(renamed)
     }
 }
 
@@ -22,20 +19,22 @@ enum VisitStatus {
 
 public enum AjisaiImportGraphError: Error {
     case superModNotFound(span: AjisaiSpan)
-    case invalidModName(name: String, span: AjisaiSpan)
-    case detectCycleImport(name: String, span: AjisaiSpan?)
+    case invalidModName(name: AjisaiSymbol, span: AjisaiSpan)
+    case detectCycleImport(name: AjisaiSymbol, span: AjisaiSpan?)
 }
 
 final class ModuleTreeNode {
-    let modName: (orig: String, renamed: String)
+    let modName: (orig: AjisaiSymbol, renamed: AjisaiSymbol)
     let mod: AjisaiModuleNode
     var subMods: [ModuleTreeNode] = []
-    var importPaths: [(path: AjisaiPathNode, asName: String?, span: AjisaiSpan)] = []
+    var importPaths: [(path: AjisaiPathNode, asName: AjisaiSymbol?, span: AjisaiSpan)] = []
     let superMod: ModuleTreeNode?
     var visitStatus: VisitStatus = .unvisited
 
-    init(modName: (orig: String, renamed: String), mod: AjisaiModuleNode, superMod: ModuleTreeNode?)
-    {
+    init(
+        modName: (orig: AjisaiSymbol, renamed: AjisaiSymbol), mod: AjisaiModuleNode,
+        superMod: ModuleTreeNode?
+    ) {
         self.modName = modName
         self.mod = mod
         self.superMod = superMod
@@ -120,14 +119,14 @@ final class ModuleTreeNode {
 }
 
 public final class AjisaiImportGraphNode<Module> {
-    public let modName: (orig: String, renamed: String)
+    public let modName: (orig: AjisaiSymbol, renamed: AjisaiSymbol)
     public var mod: Module
     public var isAnalyzed: Bool = false
-    public var importMods: [(name: String, node: AjisaiImportGraphNode<Module>)] = []
+    public var importMods: [(name: AjisaiSymbol, node: AjisaiImportGraphNode<Module>)] = []
     public let importerMod: AjisaiImportGraphNode<Module>?
 
     init(
-        modName: (orig: String, renamed: String), mod: Module,
+        modName: (orig: AjisaiSymbol, renamed: AjisaiSymbol), mod: Module,
         importerMod: AjisaiImportGraphNode?
     ) {
         self.modName = modName
@@ -7,13 +7,13 @@ public enum AjisaiSemantError: Error {
     case invalidFuncReturnType(expected: String, got: String, span: AjisaiSpan?)
     case typeError(content: TypeError)
     case invalidCalleeType(got: String)
-    case variableNotFound(name: String, span: AjisaiSpan?)
-    case variableNotInPrecedingDefinitions(name: String, span: AjisaiSpan?)
-    case duplicatedVarInLet(name: String, span: AjisaiSpan?)
-    case duplicatedVarInFuncParams(name: String, span: AjisaiSpan?)
-    case moduleNotFound(name: String, span: AjisaiSpan?)
-    case nestedModuleAccess(name: String, span: AjisaiSpan?)
-    case modLevelVariableNotFound(name: String, modName: String, span: AjisaiSpan?)
+    case variableNotFound(name: AjisaiSymbol, span: AjisaiSpan?)
+    case variableNotInPrecedingDefinitions(name: AjisaiSymbol, span: AjisaiSpan?)
+    case duplicatedVarInLet(name: AjisaiSymbol, span: AjisaiSpan?)
+    case duplicatedVarInFuncParams(name: AjisaiSymbol, span: AjisaiSpan?)
+    case moduleNotFound(name: AjisaiSymbol, span: AjisaiSpan?)
+    case nestedModuleAccess(name: AjisaiSymbol, span: AjisaiSpan?)
+    case modLevelVariableNotFound(name: AjisaiSymbol, modName: AjisaiSymbol, span: AjisaiSpan?)
 }
 
 public typealias SemantResult<T> = Result<T, AjisaiSemantError>
@@ -69,10 +69,10 @@ func makeModEnv(mod: AjisaiModuleNode, envId: UInt, builtins: AjisaiEnv) -> Ajis
 
 final class AjisaiSemanticAnalyzer {
     var importGraph: AjisaiImportGraphNode<AjisaiModuleNode>
-    var analyzedImportMods: [(name: String, node: AjisaiImportGraphNode<AjisaiModule>)] = []
+    var analyzedImportMods: [(name: AjisaiSymbol, node: AjisaiImportGraphNode<AjisaiModule>)] = []
     var additionalDefs: [AjisaiVariableDeclare] = []
     var inFuncDef = false
-    var precedingDefTypeMap: [String: AjisaiType] = [:]
+    var precedingDefTypeMap: [AjisaiSymbol: AjisaiType] = [:]
 
     let closureIdState: AjisaiRef<UInt>
     let globalRootIdState: AjisaiRef<UInt>
@@ -200,7 +200,7 @@ final class AjisaiSemanticAnalyzer {
     }
 
     func analyzeVal(
-        name: String, ty: AjisaiTypeNode, value: AjisaiExprNode, span: AjisaiSpan?,
+        name: AjisaiSymbol, ty: AjisaiTypeNode, value: AjisaiExprNode, span: AjisaiSpan?,
         modEnv: AjisaiEnv
     )
         -> SemantResult<AjisaiModuleItem>
@@ -223,8 +223,8 @@ final class AjisaiSemanticAnalyzer {
     }
 
     func analyzeTypedDeclare(
-        letLevel: UInt, name: String, ty: AjisaiType, value: AjisaiExprNode, span: AjisaiSpan?,
-        varEnv: AjisaiEnv
+        letLevel: UInt, name: AjisaiSymbol, ty: AjisaiType, value: AjisaiExprNode,
+        span: AjisaiSpan?, varEnv: AjisaiEnv
     )
         -> SemantResult<AjisaiVariableDeclare>
     {
@@ -246,7 +246,7 @@ final class AjisaiSemanticAnalyzer {
     }
 
     func analyzeFunc(
-        name: String, value: AjisaiExprNode, span: AjisaiSpan?, modEnv: AjisaiEnv
+        name: AjisaiSymbol, value: AjisaiExprNode, span: AjisaiSpan?, modEnv: AjisaiEnv
     )
         -> SemantResult<AjisaiModuleItem>
     {
@@ -264,7 +264,8 @@ final class AjisaiSemanticAnalyzer {
     }
 
     func analyzeDeclare(
-        letLevel: UInt, name: String, value: AjisaiExprNode, span: AjisaiSpan?, varEnv: AjisaiEnv
+        letLevel: UInt, name: AjisaiSymbol, value: AjisaiExprNode, span: AjisaiSpan?,
+        varEnv: AjisaiEnv
     )
         -> SemantResult<AjisaiVariableDeclare>
     {
@@ -316,7 +317,7 @@ final class AjisaiSemanticAnalyzer {
                         switch result.expr {
                         case .funcNode(
                             args: _, body: _, bodyTy: _, ty: _, envId: _, rootTableSize: _,
-                            closureId: _, rootIdx: _):
+                            closureId: _, rootIdx: _, span: _):
                             .function(kind: .userdef, argTypes: argTypes, bodyType: bodyType)
                         default:
                             .function(kind: .closure, argTypes: argTypes, bodyType: bodyType)
@@ -375,8 +376,9 @@ final class AjisaiSemanticAnalyzer {
             return analyzeFnExpr(
                 letLevel: letLevel, args: args, body: body, bodyTy: bodyTy, span: span,
                 parentEnv: varEnv)
-        case let .callNode(callee: callee, args: args, span: _):
-            return analyzeCall(letLevel: letLevel, callee: callee, args: args, varEnv: varEnv)
+        case let .callNode(callee: callee, args: args, span: span):
+            return analyzeCall(
+                letLevel: letLevel, callee: callee, args: args, span: span, varEnv: varEnv)
         case let .letNode(declares: declares, body: body, span: _):
             return analyzeLet(letLevel: letLevel, declares: declares, body: body, parentEnv: varEnv)
         case let .ifNode(cond: cond, then: then, els: els, span: _):
@@ -384,9 +386,10 @@ final class AjisaiSemanticAnalyzer {
         case let .unaryNode(opKind: opKind, operand: operand, span: _):
             return analyzeUnary(
                 letLevel: letLevel, opKind: opKind, operand: operand, varEnv: varEnv)
-        case let .binaryNode(opKind: opKind, left: lhs, right: rhs, span: _):
+        case let .binaryNode(opKind: opKind, left: lhs, right: rhs, span: span):
             return analyzeBinary(
-                letLevel: letLevel, opKind: opKind, lhs: lhs, rhs: rhs, varEnv: varEnv)
+                letLevel: letLevel, opKind: opKind, lhs: lhs, rhs: rhs, span: span,
+                varEnv: varEnv)
         case let .variableNode(name: name, span: span):
             return analyzeVariable(letLevel: letLevel, varName: name, span: span, varEnv: varEnv)
         case let .pathNode(path):
@@ -423,7 +426,7 @@ final class AjisaiSemanticAnalyzer {
     }
 
     func analyzeFnExpr(
-        letLevel: UInt, args: [(name: String, ty: AjisaiTypeNode?, span: AjisaiSpan?)],
+        letLevel: UInt, args: [(name: AjisaiSymbol, ty: AjisaiTypeNode?, span: AjisaiSpan?)],
         body: AjisaiExprNode,
         bodyTy: AjisaiTypeNode?, span: AjisaiSpan?, parentEnv: AjisaiEnv
     ) -> SemantResult<(expr: AjisaiExpr, ty: AjisaiType)> {
@@ -506,12 +509,13 @@ final class AjisaiSemanticAnalyzer {
 
             let fnExpr: AjisaiExpr = .funcNode(
                 args: funcArgs, body: bodyExpr, bodyTy: bodyType, ty: funcTy, envId: varEnv.envId,
-                rootTableSize: varEnv.rootTableSize, closureId: closureId, rootIdx: rootIdx)
+                rootTableSize: varEnv.rootTableSize, closureId: closureId, rootIdx: rootIdx,
+                span: span)
 
             if funcKind == .closure {
                 additionalDefs.append(
                     AjisaiVariableDeclare(
-                        name: String(closureId!), ty: funcTy, value: fnExpr,
+                        name: AjisaiSymbol(String(closureId!)), ty: funcTy, value: fnExpr,
                         modName: importGraph.modName.renamed, globalRootIdx: nil))
             }
 
@@ -520,7 +524,8 @@ final class AjisaiSemanticAnalyzer {
     }
 
     func analyzeCall(
-        letLevel: UInt, callee: AjisaiExprNode, args: [AjisaiExprNode], varEnv: AjisaiEnv
+        letLevel: UInt, callee: AjisaiExprNode, args: [AjisaiExprNode], span: AjisaiSpan?,
+        varEnv: AjisaiEnv
     )
         -> SemantResult<(expr: AjisaiExpr, ty: AjisaiType)>
     {
@@ -552,7 +557,8 @@ final class AjisaiSemanticAnalyzer {
                         expr: .callNode(
                             callee: calleeExpr, args: analyzedArgs, ty: returnType,
                             calleeTy: calleeTy,
-                            rootIdx: returnType.mayBeHeapObject() ? varEnv.freshRootId() : nil),
+                            rootIdx: returnType.mayBeHeapObject() ? varEnv.freshRootId() : nil,
+                            span: span),
                         ty: returnType
                     ))
             }
@@ -654,7 +660,9 @@ final class AjisaiSemanticAnalyzer {
         return f(ty: ty)
     }
 
-    func analyzeVariable(letLevel: UInt, varName: String, span: AjisaiSpan?, varEnv: AjisaiEnv)
+    func analyzeVariable(
+        letLevel: UInt, varName: AjisaiSymbol, span: AjisaiSpan?, varEnv: AjisaiEnv
+    )
         -> SemantResult<
             (expr: AjisaiExpr, ty: AjisaiType)
         >
@@ -875,7 +883,7 @@ final class AjisaiSemanticAnalyzer {
 
     func analyzeBinary(
         letLevel: UInt, opKind: AjisaiBinOpKind, lhs: AjisaiExprNode, rhs: AjisaiExprNode,
-        varEnv: AjisaiEnv
+        span: AjisaiSpan?, varEnv: AjisaiEnv
     ) -> SemantResult<(expr: AjisaiExpr, ty: AjisaiType)> {
         // TODO: 最終的には各演算子に対応した trait が実装されているかどうか調べる検査に置き換える
         // かもしれない
@@ -921,7 +929,8 @@ final class AjisaiSemanticAnalyzer {
                                         opKind: opKind1, left: leftExpr, right: rightExpr,
                                         ty: leftTy,
                                         rootIdx: leftTy.mayBeHeapObject()
-                                            ? varEnv.freshRootId() : nil),
+                                            ? varEnv.freshRootId() : nil,
+                                        span: span),
                                     ty: leftTy
                                 ))
                         }
@@ -949,7 +958,7 @@ final class AjisaiSemanticAnalyzer {
                                 (
                                     expr: .binaryNode(
                                         opKind: opKind1, left: leftExpr, right: rightExpr, ty: .i32,
-                                        rootIdx: nil),
+                                        rootIdx: nil, span: span),
                                     ty: .i32
                                 ))
                         }
@@ -979,7 +988,7 @@ final class AjisaiSemanticAnalyzer {
                                     expr: .binaryNode(
                                         opKind: opKind1, left: leftExpr, right: rightExpr,
                                         ty: .bool,
-                                        rootIdx: nil),
+                                        rootIdx: nil, span: span),
                                     ty: .bool
                                 ))
                         }
@@ -1008,7 +1017,7 @@ final class AjisaiSemanticAnalyzer {
                                     expr: .binaryNode(
                                         opKind: opKind1, left: leftExpr, right: rightExpr,
                                         ty: .bool,
-                                        rootIdx: nil),
+                                        rootIdx: nil, span: span),
                                     ty: .bool
                                 ))
                         }
@@ -1037,7 +1046,7 @@ final class AjisaiSemanticAnalyzer {
                                     expr: .binaryNode(
                                         opKind: opKind1, left: leftExpr, right: rightExpr,
                                         ty: .bool,
-                                        rootIdx: nil),
+                                        rootIdx: nil, span: span),
                                     ty: .bool
                                 ))
                         }
@@ -183,4 +183,50 @@ struct AjisaiLexerTest {
             #expect(Bool(false), "result3 is failure (\(result3))")
         }
     }
+
+    @Test("token count test")
+    func tokenCountTest() {
+        let lexer = AjisaiLexer(srcURL: URL(filePath: "."), srcContent: "12 + 34")
+        _ = lexer.peekToken()
+        #expect(lexer.tokenCount == 0)
+
+        while case .success = lexer.nextToken() {}
+        #expect(lexer.tokenCount == 3)
+    }
+
+    @Test("source location test")
+    func sourceLocationTest() {
+        let lexer = AjisaiLexer(
+            srcURL: URL(filePath: "dir/main.ajs"), srcContent: "12 +\n  34\n\n\"a\"")
+        var spans: [AjisaiSpan] = []
+        while case .success(let tokenAndSpan) = lexer.nextToken() {
+            spans.append(tokenAndSpan.span)
+        }
+
+        let locator = AjisaiSourceLocator()
+        #expect(
+            spans.map { span in locator.location(of: span) } == [
+                "main.ajs:1:1", "main.ajs:1:4", "main.ajs:2:3", "main.ajs:4:1",
+            ])
+    }
+
+    @Test("identifier interning test")
+    func identifierInterningTest() {
+        let lexer = AjisaiLexer(
+            srcURL: URL(filePath: "."), srcContent: "interned_name other_name interned_name")
+        var symbols: [AjisaiSymbol] = []
+        while case .success(let tokenAndSpan) = lexer.nextToken() {
+            if case .ident(let symbol) = tokenAndSpan.token {
+                symbols.append(symbol)
+            }
+        }
+
+        #expect(symbols.count == 3)
+        #expect(symbols[0].id == symbols[2].id)
+        #expect(symbols[0].id != symbols[1].id)
+        #expect(
+            symbols.map { symbol in symbol.text } == [
+                "interned_name", "other_name", "interned_name",
+            ])
+    }
 }
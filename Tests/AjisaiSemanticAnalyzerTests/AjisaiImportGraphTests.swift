@@ -14,7 +14,7 @@ struct AjisaiImportGraphTest {
                 guard importGraph.importMods.isEmpty else {
                     return false
                 }
-                return importGraph.modName.orig == name
+                return importGraph.modName.orig == AjisaiSymbol(name)
             case let .tree(name: name, childs: childs):
                 guard importGraph.importMods.count == childs.count else {
                     return false
@@ -24,7 +24,7 @@ struct AjisaiImportGraphTest {
                         return false
                     }
                 }
-                return importGraph.modName.orig == name
+                return importGraph.modName.orig == AjisaiSymbol(name)
             }
         }
     }
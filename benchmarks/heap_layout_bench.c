@@ -0,0 +1,127 @@
+// ヒープのレイアウト（Treadmill / マークビットマップ）を同じワークロードで比較するベンチマーク。
+// run_heap_layout_bench.sh から、AJISAI_BITMAP_HEAP の有無だけを変えてビルドして実行する
+#include <time.h>
+
+#include "ajisai_runtime.h"
+
+#ifdef AJISAI_BITMAP_HEAP
+#define LAYOUT_NAME "bitmap"
+#else
+#define LAYOUT_NAME "treadmill"
+#endif // AJISAI_BITMAP_HEAP
+
+#define LIVE_SET_SIZE 20000
+
+typedef struct {
+  uint64_t start_ns, max_pause_ns;
+  size_t ops, peak_heap_bytes;
+} BenchStat;
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// 一回の確保にかかった時間を計測し、最大値（GC による停止時間を含む）を記録する
+#define TIMED(stat, manager, expr) ({                              \
+    uint64_t begin_ = now_ns();                                    \
+    __typeof__(expr) result_ = (expr);                             \
+    uint64_t elapsed_ = now_ns() - begin_;                         \
+    if (elapsed_ > (stat)->max_pause_ns)                           \
+      (stat)->max_pause_ns = elapsed_;                             \
+    if ((manager)->heap_bytes > (stat)->peak_heap_bytes)           \
+      (stat)->peak_heap_bytes = (manager)->heap_bytes;             \
+    (stat)->ops++;                                                 \
+    result_;                                                       \
+  })
+
+static AjisaiString hello = { .obj_header = { .tag = AJISAI_OBJ_STR }, .len = 5, .value = "hello" };
+
+static uint32_t xorshift(uint32_t *state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 17;
+  *state ^= *state << 5;
+  return *state;
+}
+
+// 短命な文字列とクロージャを大量に確保する。生存するオブジェクトはほとんどない
+static void bench_churn(AjisaiFuncFrame *frame, BenchStat *stat, size_t iterations) {
+  AjisaiMemManager *manager = frame->mem_manager;
+  for (size_t i = 0; i < iterations; i++) {
+    frame->root_table[0] = (AjisaiObject *)TIMED(stat, manager, ajisai_str_repeat(frame, &hello, 4));
+    frame->root_table[1] = (AjisaiObject *)TIMED(stat, manager, ajisai_closure_new(frame, NULL, NULL));
+  }
+}
+
+// 大きな生存集合を保ったまま、ランダムな要素を新しい文字列に置き換える
+static void bench_live_set(AjisaiFuncFrame *frame, BenchStat *stat, size_t iterations) {
+  AjisaiMemManager *manager = frame->mem_manager;
+  uint32_t rng = 2463534242u;
+  for (size_t i = 0; i < frame->root_table_size; i++)
+    frame->root_table[i] = (AjisaiObject *)TIMED(stat, manager, ajisai_str_repeat(frame, &hello, 2));
+  for (size_t i = 0; i < iterations; i++) {
+    size_t idx = xorshift(&rng) % frame->root_table_size;
+    frame->root_table[idx] = (AjisaiObject *)TIMED(stat, manager, ajisai_str_repeat(frame, &hello, 2));
+  }
+}
+
+// 生存集合の文字列を参照するスライスを作り、スライス経由でのみ元の文字列を生かす
+static void bench_slices(AjisaiFuncFrame *frame, BenchStat *stat, size_t iterations) {
+  AjisaiMemManager *manager = frame->mem_manager;
+  uint32_t rng = 88172645u;
+  for (size_t i = 0; i < frame->root_table_size; i++)
+    frame->root_table[i] = (AjisaiObject *)TIMED(stat, manager, ajisai_str_repeat(frame, &hello, 3));
+  for (size_t i = 0; i < iterations; i++) {
+    size_t idx = xorshift(&rng) % frame->root_table_size;
+    AjisaiString *src = (AjisaiString *)frame->root_table[idx];
+    if (xorshift(&rng) % 2 == 0 && src->len > 1)
+      frame->root_table[idx] = (AjisaiObject *)TIMED(stat, manager, ajisai_str_slice(frame, src, 1, src->len));
+    else
+      frame->root_table[idx] = (AjisaiObject *)TIMED(stat, manager, ajisai_str_repeat(frame, &hello, 3));
+  }
+}
+
+typedef struct {
+  const char *name;
+  void (*run)(AjisaiFuncFrame *, BenchStat *, size_t);
+  size_t root_table_size;
+} Workload;
+
+int main(int argc, char **argv) {
+  size_t iterations = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+  Workload workloads[] = {
+    { "churn", bench_churn, 2 },
+    { "live_set", bench_live_set, LIVE_SET_SIZE },
+    { "slices", bench_slices, LIVE_SET_SIZE },
+  };
+
+  hello.obj_header.type_info = ajisai_str_type_info();
+
+  printf("%-10s %-10s %10s %10s %10s %14s %14s %8s\n",
+         "layout", "workload", "ops", "total ms", "ns/op", "max pause us", "peak heap KiB", "cycles");
+  for (size_t w = 0; w < sizeof(workloads) / sizeof(workloads[0]); w++) {
+    AjisaiMemManager mem_manager;
+    if (ajisai_mem_manager_init(&mem_manager) < 0) {
+      fprintf(stderr, "error: failed to initialize memory manager\n");
+      return 1;
+    }
+    AjisaiObject **root_table = calloc(workloads[w].root_table_size, sizeof(AjisaiObject *));
+    AjisaiFuncFrame frame = {
+      .parent = NULL, .mem_manager = &mem_manager,
+      .root_table_size = workloads[w].root_table_size, .root_table = root_table
+    };
+
+    BenchStat stat = { .start_ns = now_ns() };
+    workloads[w].run(&frame, &stat, iterations);
+    uint64_t total_ns = now_ns() - stat.start_ns;
+
+    printf("%-10s %-10s %10zu %10.1f %10.1f %14.1f %14zu %8zu\n",
+           LAYOUT_NAME, workloads[w].name, stat.ops, total_ns / 1e6, (double)total_ns / stat.ops,
+           stat.max_pause_ns / 1e3, stat.peak_heap_bytes / 1024, mem_manager.gc_cycle_count);
+
+    ajisai_mem_manager_deinit(&mem_manager);
+    free(root_table);
+  }
+  return 0;
+}
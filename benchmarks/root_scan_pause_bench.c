@@ -0,0 +1,116 @@
+// 深い再帰の最中にオブジェクトを確保し、ルートの走査による停止時間を計測するベンチマーク。
+// run_root_scan_pause_bench.sh から、ヒープのレイアウトと AJISAI_ROOT_SCAN_STEP を変えてビルドして実行する
+#include <time.h>
+
+#include "ajisai_runtime.h"
+
+#ifdef AJISAI_BITMAP_HEAP
+#define LAYOUT_NAME "bitmap"
+#else
+#define LAYOUT_NAME "treadmill"
+#endif // AJISAI_BITMAP_HEAP
+
+#ifdef AJISAI_ROOT_SCAN_STEP
+#define ROOT_SCAN_NAME "full"
+#else
+#define ROOT_SCAN_NAME "incremental"
+#endif // AJISAI_ROOT_SCAN_STEP
+
+#define FRAME_ROOTS 8
+#define ALLOCS_AT_BOTTOM 200000
+// スケジューラによる中断などの影響を除くため、同じ深さで複数回実行して停止時間の最も短い回を報告する
+#define REPEATS 3
+
+// max_pause_ns は全ての確保、bottom_max_pause_ns は最深部での確保（ヒープが十分に伸びた後）における最大の停止時間
+typedef struct {
+  uint64_t max_pause_ns, bottom_max_pause_ns;
+  size_t ops;
+} BenchStat;
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static AjisaiString hello = { .obj_header = { .tag = AJISAI_OBJ_STR }, .len = 5, .value = "hello" };
+
+static AjisaiString *timed_alloc(AjisaiFuncFrame *frame, BenchStat *stat, uint64_t *max_pause_ns) {
+  uint64_t begin = now_ns();
+  AjisaiString *str = ajisai_str_repeat(frame, &hello, 2);
+  uint64_t elapsed = now_ns() - begin;
+  if (elapsed > *max_pause_ns)
+    *max_pause_ns = elapsed;
+  stat->ops++;
+  return str;
+}
+
+// 生成コードの関数と同じく、フレームごとにルートのテーブルを持ち、戻る直前にリターンバリアを通す
+static void recurse(AjisaiFuncFrame *parent_frame, BenchStat *stat, size_t depth) {
+  AjisaiObject *root_table[FRAME_ROOTS] = {};
+  AjisaiFuncFrame func_frame = {
+    .parent = parent_frame, .mem_manager = parent_frame->mem_manager,
+    .root_table_size = FRAME_ROOTS, .root_table = root_table
+  };
+
+  for (size_t i = 0; i < FRAME_ROOTS; i++)
+    root_table[i] = (AjisaiObject *)timed_alloc(&func_frame, stat, &stat->max_pause_ns);
+
+  if (depth > 0) {
+    recurse(&func_frame, stat, depth - 1);
+    // 呼び出し元に戻った後でルートを書き換える
+    root_table[depth % FRAME_ROOTS] = (AjisaiObject *)timed_alloc(&func_frame, stat, &stat->max_pause_ns);
+  } else {
+    for (size_t i = 0; i < ALLOCS_AT_BOTTOM; i++)
+      root_table[i % FRAME_ROOTS] = (AjisaiObject *)timed_alloc(&func_frame, stat, &stat->bottom_max_pause_ns);
+    if (stat->bottom_max_pause_ns > stat->max_pause_ns)
+      stat->max_pause_ns = stat->bottom_max_pause_ns;
+  }
+
+  ajisai_func_frame_leave(&func_frame);
+}
+
+int main(int argc, char **argv) {
+  size_t depths[] = { 100, 1000, 10000, 40000 };
+  size_t depth_count = sizeof(depths) / sizeof(depths[0]);
+  if (argc > 1) {
+    depths[0] = strtoul(argv[1], NULL, 10);
+    depth_count = 1;
+  }
+
+  hello.obj_header.type_info = ajisai_str_type_info();
+
+  printf("%-10s %-12s %8s %10s %10s %14s %16s %8s\n",
+         "layout", "root scan", "depth", "ops", "total ms", "max pause us", "bottom pause us", "cycles");
+  for (size_t d = 0; d < depth_count; d++) {
+    BenchStat best = { .max_pause_ns = UINT64_MAX };
+    uint64_t best_total_ns = 0;
+    size_t best_cycles = 0;
+
+    for (size_t r = 0; r < REPEATS; r++) {
+      AjisaiMemManager mem_manager;
+      if (ajisai_mem_manager_init(&mem_manager) < 0) {
+        fprintf(stderr, "error: failed to initialize memory manager\n");
+        return 1;
+      }
+      AjisaiFuncFrame frame = { .parent = NULL, .mem_manager = &mem_manager, .root_table_size = 0 };
+
+      BenchStat stat = {};
+      uint64_t start_ns = now_ns();
+      recurse(&frame, &stat, depths[d]);
+      uint64_t total_ns = now_ns() - start_ns;
+
+      if (stat.max_pause_ns < best.max_pause_ns) {
+        best = stat;
+        best_total_ns = total_ns;
+        best_cycles = mem_manager.gc_cycle_count;
+      }
+      ajisai_mem_manager_deinit(&mem_manager);
+    }
+
+    printf("%-10s %-12s %8zu %10zu %10.1f %14.1f %16.1f %8zu\n",
+           LAYOUT_NAME, ROOT_SCAN_NAME, depths[d], best.ops, best_total_ns / 1e6,
+           best.max_pause_ns / 1e3, best.bottom_max_pause_ns / 1e3, best_cycles);
+  }
+  return 0;
+}
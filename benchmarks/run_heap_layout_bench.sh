@@ -0,0 +1,17 @@
+#!/bin/sh
+# Treadmill とマークビットマップの両方のヒープでベンチマークをビルドし、同じワークロードで比較する
+# 使い方: benchmarks/run_heap_layout_bench.sh [反復回数]
+set -eu
+
+ROOT_DIR=$(cd "$(dirname "$0")/.." && pwd)
+BUILD_DIR=${BUILD_DIR:-"${TMPDIR:-/tmp}/ajisai-benchmarks"}
+CC=${CC:-cc}
+mkdir -p "$BUILD_DIR"
+
+"$CC" -O2 -I"$ROOT_DIR/runtime" -o "$BUILD_DIR/heap_layout_bench_treadmill" \
+  "$ROOT_DIR/benchmarks/heap_layout_bench.c" "$ROOT_DIR/runtime/ajisai_runtime.c"
+"$CC" -O2 -DAJISAI_BITMAP_HEAP -I"$ROOT_DIR/runtime" -o "$BUILD_DIR/heap_layout_bench_bitmap" \
+  "$ROOT_DIR/benchmarks/heap_layout_bench.c" "$ROOT_DIR/runtime/ajisai_runtime.c"
+
+"$BUILD_DIR/heap_layout_bench_treadmill" "$@"
+"$BUILD_DIR/heap_layout_bench_bitmap" "$@" | tail -n +2
@@ -0,0 +1,73 @@
+#!/bin/sh
+# 多数のモジュール・関数・ローカル変数を持つ合成ソースを生成し、コンパイラの各フェーズの時間を --stats で計測する
+# BASELINE_REV に git のリビジョンを指定すると、そのリビジョンのコンパイラでも同じソースを計測して比較する
+# 使い方: [BASELINE_REV=<rev>] benchmarks/run_large_module_compile_bench.sh [モジュール数] [モジュールあたりの関数の数]
+set -eu
+
+ROOT_DIR=$(cd "$(dirname "$0")/.." && pwd)
+BUILD_DIR=${BUILD_DIR:-"${TMPDIR:-/tmp}/ajisai-benchmarks"}
+MODULES=${1:-50}
+FUNCS=${2:-200}
+RUNS=${RUNS:-3}
+mkdir -p "$BUILD_DIR"
+
+src="$BUILD_DIR/large_module.ajs"
+
+# 各関数は直前の関数を呼び出し、長めの名前のローカル変数を let で束縛する。
+# エントリモジュールは全てのサブモジュールを import して、その最後の関数を呼び出す
+awk -v modules="$MODULES" -v funcs="$FUNCS" 'BEGIN {
+  for (m = 0; m < modules; m++) {
+    printf "module generated_module_%d {\n", m
+    printf "    func step_function_0(input_value_a: i32, input_value_b: i32) -> i32 { input_value_a - input_value_b }\n"
+    for (f = 1; f < funcs; f++) {
+      printf "    func step_function_%d(input_value_a: i32, input_value_b: i32) -> i32 {\n", f
+      printf "        let val intermediate_sum_value = input_value_a + input_value_b\n"
+      printf "            val intermediate_product_value = intermediate_sum_value * %d\n", f % 7 + 2
+      printf "        {\n"
+      printf "            step_function_%d(intermediate_product_value %% 1000, intermediate_sum_value - input_value_a)\n", f - 1
+      printf "        }\n"
+      printf "    }\n"
+    }
+    printf "}\n\n"
+  }
+  for (m = 0; m < modules; m++) {
+    printf "import generated_module_%d;\n", m
+  }
+  printf "\n"
+  for (m = 0; m < modules; m++) {
+    printf "println_i32(generated_module_%d::step_function_%d(%d, 2));\n", m, funcs - 1, m
+  }
+}' > "$src"
+echo "generated $src: $MODULES modules x $FUNCS functions, $(wc -c < "$src") bytes"
+
+build_ajisai() {
+  swift build -c release --package-path "$1" >&2
+  echo "$(swift build -c release --package-path "$1" --show-bin-path)/ajisai"
+}
+
+# ajisai は入力ファイルと runtime をカレントディレクトリからの相対パスで参照し、ajisai-out に C ソースを出力する
+run_bench() {
+  label=$1
+  bin=$2
+  work="$BUILD_DIR/large_module_$label"
+  mkdir -p "$work"
+  ln -sfn "$ROOT_DIR/runtime" "$work/runtime"
+  cp "$src" "$work/large_module.ajs"
+  i=0
+  while [ "$i" -lt "$RUNS" ]; do
+    echo "== $label (run $((i + 1))/$RUNS)"
+    (cd "$work" && "$bin" large_module.ajs --stats)
+    i=$((i + 1))
+  done
+}
+
+if [ -n "${BASELINE_REV:-}" ]; then
+  baseline_dir="$BUILD_DIR/ajisai-baseline"
+  if [ ! -d "$baseline_dir" ]; then
+    git -C "$ROOT_DIR" worktree add --detach "$baseline_dir" "$BASELINE_REV" >&2
+  else
+    git -C "$baseline_dir" checkout --detach "$BASELINE_REV" >&2
+  fi
+  run_bench baseline "$(build_ajisai "$baseline_dir")"
+fi
+run_bench current "$(build_ajisai "$ROOT_DIR")"
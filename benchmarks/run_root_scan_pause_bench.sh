@@ -0,0 +1,35 @@
+#!/bin/sh
+# 深い再帰でのルート走査による最大停止時間を、インクリメンタルな走査と一度に全て走査する場合とで比較する
+# 使い方: benchmarks/run_root_scan_pause_bench.sh [再帰の深さ]
+set -eu
+
+ROOT_DIR=$(cd "$(dirname "$0")/.." && pwd)
+BUILD_DIR=${BUILD_DIR:-"${TMPDIR:-/tmp}/ajisai-benchmarks"}
+CC=${CC:-cc}
+mkdir -p "$BUILD_DIR"
+
+# 深さ 40000 の再帰がデフォルトのスタックに収まらない環境に備える
+ulimit -s unlimited 2>/dev/null || ulimit -s 65536 2>/dev/null || true
+
+first=1
+for layout in treadmill bitmap; do
+  layout_flags=""
+  if [ "$layout" = bitmap ]; then
+    layout_flags="-DAJISAI_BITMAP_HEAP"
+  fi
+  for scan in full incremental; do
+    scan_flags=""
+    if [ "$scan" = full ]; then
+      scan_flags="-DAJISAI_ROOT_SCAN_STEP=SIZE_MAX"
+    fi
+    bin="$BUILD_DIR/root_scan_pause_bench_${layout}_${scan}"
+    "$CC" -O2 $layout_flags $scan_flags -I"$ROOT_DIR/runtime" -o "$bin" \
+      "$ROOT_DIR/benchmarks/root_scan_pause_bench.c" "$ROOT_DIR/runtime/ajisai_runtime.c"
+    if [ "$first" = 1 ]; then
+      "$bin" "$@"
+      first=0
+    else
+      "$bin" "$@" | tail -n +2
+    fi
+  done
+done
@@ -1,5 +1,11 @@
+#include <errno.h>
+
 #include "ajisai_runtime.h"
 
+#ifdef AJISAI_HEAP_PROFILE
+#include <math.h>
+#endif // AJISAI_HEAP_PROFILE
+
 #define AJISAI_SCAN_PHASE_IS_SUCCESSFULLY_OVER 0
 #define AJISAI_SCAN_PHASE_STILL_CONTINUES 1
 
@@ -9,11 +15,841 @@
 #define AJISAI_MEMCELL_ALLOCATOR_ADD_BLOCK_FAILED -2
 #define AJISAI_FREE_MEMCELLS_INIT_FAILED -3
 #define AJISAI_MEM_MANAGER_INIT_FAILED -4
+#define AJISAI_HEAP_PROFILE_INIT_FAILED -5
 
 #ifdef AJISAI_MEMORY_MANAGER_DEBUG_OUTPUT
 #define AJISAI_DEBUG_LOG(kind, ...) fprintf(stderr, "[" kind "] " __VA_ARGS__)
 #endif // AJISAI_MEMORY_MANAGER_DEBUG_OUTPUT
 
+// 環境変数 AJISAI_HEAP_LIMIT が設定されていればその値を、そうでなければ AJISAI_HEAP_LIMIT マクロの値を返す
+static size_t ajisai_heap_limit_from_env(void) {
+  const char *value = getenv("AJISAI_HEAP_LIMIT");
+  if (value == NULL || *value == '\0')
+    return AJISAI_HEAP_LIMIT;
+
+  char *end;
+  errno = 0;
+  unsigned long long limit = strtoull(value, &end, 10);
+  // strtoull は先頭の空白や負号も受け付けるので、数字で始まることを確かめる
+  bool valid = *value >= '0' && *value <= '9' && errno != ERANGE;
+  unsigned shift = 0;
+  switch (*end) {
+    case 'k': case 'K':
+      shift = 10;
+      end++;
+      break;
+    case 'm': case 'M':
+      shift = 20;
+      end++;
+      break;
+    case 'g': case 'G':
+      shift = 30;
+      end++;
+      break;
+    default:
+      break;
+  }
+  if (!valid || *end != '\0' || limit > (SIZE_MAX >> shift)) {
+    fprintf(stderr, "warning: ignoring invalid AJISAI_HEAP_LIMIT '%s'\n", value);
+    return AJISAI_HEAP_LIMIT;
+  }
+  return (size_t)limit << shift;
+}
+
+#ifdef AJISAI_HEAP_PROFILE
+// 平均 AJISAI_HEAP_PROFILE_SAMPLE_BYTES の指数分布から次のサンプリングまでのバイト数を引く。
+// 間隔を乱数にすることで、一定の順序で確保を繰り返すアロケーションサイト同士がサンプリングの周期と干渉しないようにする
+static int64_t ajisai_heap_profile_next_interval(AjisaiHeapProfile *profile) {
+  // xorshift64* による [0, 1) の一様乱数
+  uint64_t x = profile->rng_state;
+  x ^= x >> 12;
+  x ^= x << 25;
+  x ^= x >> 27;
+  profile->rng_state = x;
+  double u = (double)((x * 0x2545F4914F6CDD1DULL) >> 11) / (double)(1ULL << 53);
+
+  return (int64_t)(-log(1.0 - u) * AJISAI_HEAP_PROFILE_SAMPLE_BYTES) + 1;
+}
+
+int ajisai_heap_profile_init(AjisaiMemManager *manager, const AjisaiAllocSite *sites, size_t site_count) {
+  AjisaiHeapProfile *profile = &manager->heap_profile;
+
+  profile->stats = calloc(site_count, sizeof(AjisaiAllocSiteStat));
+  if (profile->stats == NULL)
+    return AJISAI_HEAP_PROFILE_INIT_FAILED;
+
+  profile->sites = sites;
+  profile->site_count = site_count;
+  profile->rng_state = 0x9E3779B97F4A7C15ULL;
+  profile->bytes_until_sample = ajisai_heap_profile_next_interval(profile);
+  profile->dump_count = 0;
+  return AJISAI_SUCCESS;
+}
+
+static void ajisai_heap_profile_record_alloc(
+  AjisaiMemManager *manager, uint32_t alloc_site, AjisaiAllocRecord *record, size_t bytes) {
+  AjisaiHeapProfile *profile = &manager->heap_profile;
+
+  record->alloc_site = alloc_site;
+  record->sampled_objects = 0;
+  record->sampled_bytes = 0;
+  if (profile->stats == NULL)
+    return;
+
+  // 確保したバイト数の累計が閾値を越えた確保をサンプリングする。越えた分は次の間隔に持ち越す
+  profile->bytes_until_sample -= (int64_t)bytes;
+  if (profile->bytes_until_sample > 0)
+    return;
+  do {
+    profile->bytes_until_sample += ajisai_heap_profile_next_interval(profile);
+  } while (profile->bytes_until_sample <= 0);
+
+  // bytes バイトの確保がサンプリングされる確率は 1 - exp(-bytes / 平均) なので、その逆数を重みとすると
+  // 推定値が偏らない
+  double probability = 1.0 - exp(-(double)bytes / AJISAI_HEAP_PROFILE_SAMPLE_BYTES);
+  double objects = 1.0 / probability;
+  size_t weight = (size_t)(bytes * objects + 0.5);
+
+  if (alloc_site >= profile->site_count)
+    alloc_site = 0;
+  AjisaiAllocSiteStat *stat = &profile->stats[alloc_site];
+  stat->alloc_bytes += weight;
+  stat->alloc_objects += objects;
+  stat->live_bytes += weight;
+  stat->live_objects += objects;
+
+  record->alloc_site = alloc_site;
+  record->sampled_objects = (float)objects;
+  record->sampled_bytes = weight;
+}
+
+static void ajisai_heap_profile_record_free(AjisaiMemManager *manager, AjisaiAllocRecord *record) {
+  if (record->sampled_bytes == 0)
+    return;
+
+  AjisaiAllocSiteStat *stat = &manager->heap_profile.stats[record->alloc_site];
+  stat->live_bytes -= record->sampled_bytes;
+  stat->live_objects -= record->sampled_objects;
+  record->sampled_objects = 0;
+  record->sampled_bytes = 0;
+}
+
+// 各アロケーションサイトの統計を folded stack 形式で出力する。
+// 先頭のフレームを inuse_space / inuse_objects / alloc_space / alloc_objects とすることで、
+// 一つのファイルに生存中の量と累計の量を併せて記録する。いずれもサンプリングの重みから推定した値である
+static void ajisai_heap_profile_dump(AjisaiMemManager *manager) {
+  AjisaiHeapProfile *profile = &manager->heap_profile;
+  if (profile->stats == NULL)
+    return;
+
+  const char *prefix = getenv("AJISAI_HEAP_PROFILE_OUTPUT");
+  if (prefix == NULL)
+    prefix = "ajisai-heap";
+
+  char path[4096];
+  snprintf(path, sizeof(path), "%s.%04u.folded", prefix, profile->dump_count++);
+  FILE *out = fopen(path, "w");
+  if (out == NULL) {
+    fprintf(stderr, "warning: could not open heap profile output '%s'\n", path);
+    return;
+  }
+
+  for (size_t i = 0; i < profile->site_count; i++) {
+    const AjisaiAllocSite *site = &profile->sites[i];
+    const AjisaiAllocSiteStat *stat = &profile->stats[i];
+    if (stat->live_bytes > 0) {
+      fprintf(out, "inuse_space;%s;%s %zu\n", site->func_name, site->location, stat->live_bytes);
+      fprintf(out, "inuse_objects;%s;%s %.0f\n", site->func_name, site->location, stat->live_objects);
+    }
+    if (stat->alloc_bytes > 0) {
+      fprintf(out, "alloc_space;%s;%s %zu\n", site->func_name, site->location, stat->alloc_bytes);
+      fprintf(out, "alloc_objects;%s;%s %.0f\n", site->func_name, site->location, stat->alloc_objects);
+    }
+  }
+
+  fclose(out);
+}
+#endif // AJISAI_HEAP_PROFILE
+
+void ajisai_str_heap_free(AjisaiObject *obj);
+void ajisai_closure_heap_free(AjisaiObject *obj);
+
+// オブジェクトが別途 malloc で確保して所有しているデータのサイズ
+static size_t ajisai_object_payload_size(AjisaiObject *obj) {
+  if (AJISAI_OBJ_TAG(obj) == AJISAI_OBJ_STR && AJISAI_IS_HEAP_OBJ(obj)) {
+    AjisaiString *str = (AjisaiString *)obj;
+    if (str->value != NULL)
+      return str->len + 1;
+  }
+  return 0;
+}
+
+static void ajisai_object_heap_free(AjisaiObject *obj) {
+  switch (AJISAI_OBJ_TAG(obj)) {
+    case AJISAI_OBJ_STR:
+      if (AJISAI_IS_HEAP_OBJ(obj))
+        ajisai_str_heap_free(obj);
+      break;
+    case AJISAI_OBJ_FUNC:
+      ajisai_closure_heap_free(obj);
+      break;
+    default:
+      break;
+  }
+}
+
+static void ajisai_mem_manager_emergency_collect(AjisaiFuncFrame *func_frame);
+static void ajisai_mem_manager_out_of_memory(AjisaiMemManager *mem_manager, size_t requested);
+static void ajisai_mem_manager_scan_root(AjisaiMemManager *manager, AjisaiObject *obj);
+
+// bytes を確保してもヒープ上限を超えないようにする。超える場合は緊急の GC を行い、
+// それでも超える場合はメモリ不足として終了する
+static void ajisai_mem_manager_reserve(AjisaiFuncFrame *func_frame, size_t bytes) {
+  AjisaiMemManager *mem_manager = func_frame->mem_manager;
+  if (mem_manager->heap_limit == 0 || mem_manager->heap_bytes + bytes <= mem_manager->heap_limit)
+    return;
+
+  ajisai_mem_manager_emergency_collect(func_frame);
+  if (mem_manager->heap_bytes + bytes > mem_manager->heap_limit)
+    ajisai_mem_manager_out_of_memory(mem_manager, bytes);
+}
+
+// ヒープ上限を考慮して malloc する。失敗した場合は NULL を返さずに終了する
+static void *ajisai_mem_manager_malloc(AjisaiFuncFrame *func_frame, size_t bytes) {
+  AjisaiMemManager *mem_manager = func_frame->mem_manager;
+  ajisai_mem_manager_reserve(func_frame, bytes);
+
+  void *ptr = malloc(bytes);
+  if (ptr == NULL) {
+    ajisai_mem_manager_emergency_collect(func_frame);
+    ptr = malloc(bytes);
+    if (ptr == NULL)
+      ajisai_mem_manager_out_of_memory(mem_manager, bytes);
+  }
+  mem_manager->heap_bytes += bytes;
+  return ptr;
+}
+
+// 一回のオブジェクト確保ごとに行うルートの走査の仕事量。フレームを一つ辿るか、ルートを一つ走査するごとに 1 とする
+#ifndef AJISAI_ROOT_SCAN_STEP
+#define AJISAI_ROOT_SCAN_STEP 32
+#endif // AJISAI_ROOT_SCAN_STEP
+
+static void ajisai_func_frame_scan_root_range(
+  AjisaiMemManager *manager, AjisaiFuncFrame *frame, size_t begin, size_t end) {
+  for (size_t i = begin; i < end; i++) {
+    AjisaiObject *obj = frame->root_table[i];
+    if (obj != NULL)
+      ajisai_mem_manager_scan_root(manager, obj);
+  }
+}
+
+// サイクルの開始時に呼び出す。呼び出し元のフレームは実行を再開するまでルートを書き換えないので、
+// 実行中のフレームだけをここで走査し、それ以外はウォーターマーク (root_scan_frame) 以下として後から走査する
+static void ajisai_func_frame_begin_root_scan(AjisaiFuncFrame *func_frame) {
+  AjisaiMemManager *manager = func_frame->mem_manager;
+
+  ajisai_func_frame_scan_root_range(manager, func_frame, 0, func_frame->root_table_size);
+  manager->root_scan_frame = func_frame->parent;
+  manager->root_scan_idx = 0;
+
+#ifdef AJISAI_MEMORY_MANAGER_DEBUG_OUTPUT
+  AJISAI_DEBUG_LOG("MEMORY MANAGER DEBUG", "begin_root_scan (%zu roots in current frame)\n", func_frame->root_table_size);
+#endif // AJISAI_MEMORY_MANAGER_DEBUG_OUTPUT
+}
+
+// まだ走査していないフレームのルートを最大 budget の仕事量だけ走査する。全て走査し終えていれば true を返す
+static bool ajisai_mem_manager_root_scan_step(AjisaiMemManager *manager, size_t budget) {
+  while (manager->root_scan_frame != NULL && budget > 0) {
+    AjisaiFuncFrame *frame = manager->root_scan_frame;
+    size_t begin = manager->root_scan_idx;
+
+    // 仕事量が 1 でも必ずルートを一つ走査するか親のフレームへ進むように、フレームを辿る分は最後に消費する
+    size_t end = frame->root_table_size - begin > budget ? begin + budget : frame->root_table_size;
+    ajisai_func_frame_scan_root_range(manager, frame, begin, end);
+    budget -= end - begin;
+
+    if (end < frame->root_table_size) {
+      manager->root_scan_idx = end;
+      return false;
+    }
+    manager->root_scan_frame = frame->parent;
+    manager->root_scan_idx = 0;
+    if (budget > 0)
+      budget--;
+  }
+  return manager->root_scan_frame == NULL;
+}
+
+void ajisai_mem_manager_root_barrier(AjisaiFuncFrame *func_frame) {
+  AjisaiMemManager *manager = func_frame->mem_manager;
+  AjisaiFuncFrame *frame = manager->root_scan_frame;
+
+  ajisai_func_frame_scan_root_range(manager, frame, manager->root_scan_idx, frame->root_table_size);
+  manager->root_scan_frame = frame->parent;
+  manager->root_scan_idx = 0;
+
+#ifdef AJISAI_MEMORY_MANAGER_DEBUG_OUTPUT
+  AJISAI_DEBUG_LOG("MEMORY MANAGER DEBUG", "return barrier scanned frame %p\n", frame);
+#endif // AJISAI_MEMORY_MANAGER_DEBUG_OUTPUT
+}
+
+#ifdef AJISAI_BITMAP_HEAP
+
+//
+// サイズクラスごとのセグメントとマークビットマップによるヒープ
+//
+
+// 各サイズクラスのスロットサイズ。ヒーププロファイル有効時はスロットの先頭に AjisaiAllocRecord が置かれる
+static const size_t ajisai_size_class_slot_sizes[AJISAI_SIZE_CLASS_COUNT] = { 16, 32, 48, 64, 96, 128, 256, 512 };
+
+#ifdef AJISAI_HEAP_PROFILE
+#define AJISAI_SLOT_HEADER_BYTES sizeof(AjisaiAllocRecord)
+#define AJISAI_OBJ_GET_ALLOC_RECORD(obj) ((AjisaiAllocRecord *)((uint8_t *)(obj) - sizeof(AjisaiAllocRecord)))
+#else
+#define AJISAI_SLOT_HEADER_BYTES 0
+#endif // AJISAI_HEAP_PROFILE
+
+#define AJISAI_SEGMENT_HEADER_BYTES ((sizeof(AjisaiSegment) + 15) & ~(size_t)15)
+// セグメントは AJISAI_SEGMENT_BYTES 境界に揃えて確保するので、オブジェクトのアドレスの下位ビットを落とせばヘッダが得られる
+#define AJISAI_OBJ_GET_SEGMENT(obj) ((AjisaiSegment *)((uintptr_t)(obj) & ~(uintptr_t)(AJISAI_SEGMENT_BYTES - 1)))
+
+// 一回のオブジェクト確保ごとにスキャンするグレーのオブジェクトの数
+#ifndef AJISAI_BITMAP_HEAP_MARK_STEP
+#define AJISAI_BITMAP_HEAP_MARK_STEP 4
+#endif // AJISAI_BITMAP_HEAP_MARK_STEP
+
+#ifndef AJISAI_BITMAP_HEAP_MIN_GC_BYTES
+#define AJISAI_BITMAP_HEAP_MIN_GC_BYTES (4 * AJISAI_SEGMENT_BYTES)
+#endif // AJISAI_BITMAP_HEAP_MIN_GC_BYTES
+
+// サイクル中の一回のオブジェクト確保ごとに辿る、前のサイクルから未スイープのセグメントの数
+#ifndef AJISAI_BITMAP_HEAP_SWEEP_STEP
+#define AJISAI_BITMAP_HEAP_SWEEP_STEP 1
+#endif // AJISAI_BITMAP_HEAP_SWEEP_STEP
+
+static size_t ajisai_size_class_index(size_t slot_size) {
+  for (size_t i = 0; i < AJISAI_SIZE_CLASS_COUNT; i++) {
+    if (slot_size <= ajisai_size_class_slot_sizes[i])
+      return i;
+  }
+  return AJISAI_SIZE_CLASS_COUNT;
+}
+
+// 大きなセグメントはオブジェクトの大きさに合わせて確保する。先頭のアドレスは AJISAI_SEGMENT_BYTES 境界に揃えるが、
+// オブジェクトはセグメントの先頭に置かれるので AJISAI_OBJ_GET_SEGMENT でヘッダを得られる
+static size_t ajisai_segment_bytes(size_t slot_size, bool large) {
+  return large ? AJISAI_SEGMENT_HEADER_BYTES + slot_size : AJISAI_SEGMENT_BYTES;
+}
+
+static AjisaiSegment *ajisai_segment_new(size_t slot_size, bool large, size_t sweep_epoch) {
+  size_t bytes = ajisai_segment_bytes(slot_size, large);
+  // aligned_alloc と異なり、posix_memalign はサイズがアラインメントの倍数であることを要求しない
+  void *mem;
+  if (posix_memalign(&mem, AJISAI_SEGMENT_BYTES, bytes) != 0)
+    return NULL;
+  AjisaiSegment *segment = mem;
+
+  segment->next = NULL;
+  segment->bytes = bytes;
+  segment->slot_size = slot_size;
+  segment->slot_count = large ? 1 : (bytes - AJISAI_SEGMENT_HEADER_BYTES) / slot_size;
+  segment->slots = (uint8_t *)segment + AJISAI_SEGMENT_HEADER_BYTES;
+  segment->alloc_word = 0;
+  segment->sweep_epoch = sweep_epoch;
+  memset(segment->alloc_bits, 0, sizeof(segment->alloc_bits));
+  memset(segment->mark_bits, 0, sizeof(segment->mark_bits));
+  return segment;
+}
+
+static size_t ajisai_segment_bitmap_words(AjisaiSegment *segment) {
+  return (segment->slot_count + 63) / 64;
+}
+
+static AjisaiObject *ajisai_segment_object(AjisaiSegment *segment, size_t idx) {
+  return (AjisaiObject *)(segment->slots + segment->slot_size * idx + AJISAI_SLOT_HEADER_BYTES);
+}
+
+static size_t ajisai_segment_object_index(AjisaiSegment *segment, AjisaiObject *obj) {
+  return ((uint8_t *)obj - AJISAI_SLOT_HEADER_BYTES - segment->slots) / segment->slot_size;
+}
+
+static void ajisai_mem_manager_release_object(AjisaiMemManager *manager, AjisaiObject *obj) {
+#ifdef AJISAI_HEAP_PROFILE
+  ajisai_heap_profile_record_free(manager, AJISAI_OBJ_GET_ALLOC_RECORD(obj));
+#endif // AJISAI_HEAP_PROFILE
+
+  manager->heap_bytes -= ajisai_object_payload_size(obj);
+  ajisai_object_heap_free(obj);
+}
+
+// 確保済みでマークされていないオブジェクトを解放し、マークビットを次のサイクルのためにクリアする。
+// 死んだオブジェクトはビットマップのワード単位で探すので、生きているオブジェクトには触れない
+static void ajisai_mem_manager_sweep_segment(AjisaiMemManager *manager, AjisaiSegment *segment) {
+  size_t words = ajisai_segment_bitmap_words(segment);
+
+  for (size_t w = 0; w < words; w++) {
+    uint64_t dead = segment->alloc_bits[w] & ~segment->mark_bits[w];
+    while (dead != 0) {
+      size_t idx = w * 64 + __builtin_ctzll(dead);
+      dead &= dead - 1;
+      ajisai_mem_manager_release_object(manager, ajisai_segment_object(segment, idx));
+    }
+    segment->alloc_bits[w] = segment->mark_bits[w];
+    segment->mark_bits[w] = 0;
+  }
+  segment->alloc_word = 0;
+  segment->sweep_epoch = manager->sweep_epoch;
+}
+
+// サイクル中に、前のサイクルから未スイープのセグメントを最大 budget 個だけ辿ってスイープする。
+// 全てスイープし終えていれば true を返す
+static bool ajisai_mem_manager_sweep_step(AjisaiMemManager *manager, size_t budget) {
+  while (manager->sweep_class < AJISAI_SIZE_CLASS_COUNT) {
+    AjisaiSegment *segment = manager->sweep_cursor;
+    if (segment == NULL) {
+      if (++manager->sweep_class < AJISAI_SIZE_CLASS_COUNT)
+        manager->sweep_cursor = manager->size_classes[manager->sweep_class].segments;
+      continue;
+    }
+    if (budget == 0)
+      return false;
+    budget--;
+
+    if (segment->sweep_epoch != manager->sweep_epoch)
+      ajisai_mem_manager_sweep_segment(manager, segment);
+    manager->sweep_cursor = segment->next;
+  }
+  return true;
+}
+
+static void ajisai_mem_manager_sweep_all(AjisaiMemManager *manager) {
+  for (size_t i = 0; i < AJISAI_SIZE_CLASS_COUNT; i++) {
+    for (AjisaiSegment *segment = manager->size_classes[i].segments; segment != NULL; segment = segment->next) {
+      if (segment->sweep_epoch != manager->sweep_epoch)
+        ajisai_mem_manager_sweep_segment(manager, segment);
+    }
+  }
+}
+
+// 大きなオブジェクトのセグメントはサイクルの終了時にまとめてスイープし、死んでいればセグメントごと解放する
+static void ajisai_mem_manager_sweep_large_segments(AjisaiMemManager *manager) {
+  AjisaiSegment **link = &manager->large_segments;
+
+  while (*link != NULL) {
+    AjisaiSegment *segment = *link;
+    if (segment->mark_bits[0] & 1) {
+      segment->mark_bits[0] = 0;
+      segment->sweep_epoch = manager->sweep_epoch;
+      link = &segment->next;
+    } else {
+      ajisai_mem_manager_release_object(manager, ajisai_segment_object(segment, 0));
+      *link = segment->next;
+      manager->heap_bytes -= segment->bytes;
+      free(segment);
+    }
+  }
+}
+
+#ifdef AJISAI_MEMORY_MANAGER_DEBUG_OUTPUT
+static void ajisai_mem_manager_display_stat(AjisaiMemManager *manager) {
+  size_t segment_cnt = 0, large_cnt = 0, allocated_cnt = 0, unswept_cnt = 0;
+
+  for (size_t i = 0; i < AJISAI_SIZE_CLASS_COUNT; i++) {
+    for (AjisaiSegment *segment = manager->size_classes[i].segments; segment != NULL; segment = segment->next) {
+      segment_cnt++;
+      if (segment->sweep_epoch != manager->sweep_epoch)
+        unswept_cnt++;
+      for (size_t w = 0; w < ajisai_segment_bitmap_words(segment); w++)
+        allocated_cnt += __builtin_popcountll(segment->alloc_bits[w]);
+    }
+  }
+  for (AjisaiSegment *segment = manager->large_segments; segment != NULL; segment = segment->next) large_cnt++;
+
+  AJISAI_DEBUG_LOG("MEMORY MANAGER DEBUG", "bitmap heap stat: segments %zu (%zu unswept), large %zu, allocated slots %zu, gray %zu\n",
+                   segment_cnt, unswept_cnt, large_cnt, allocated_cnt, manager->gray_stack.len);
+}
+#endif // AJISAI_MEMORY_MANAGER_DEBUG_OUTPUT
+
+int ajisai_mem_manager_init(AjisaiMemManager *manager) {
+  for (size_t i = 0; i < AJISAI_SIZE_CLASS_COUNT; i++)
+    manager->size_classes[i].segments = manager->size_classes[i].alloc_cursor = NULL;
+  manager->large_segments = NULL;
+
+  manager->gray_stack.top = malloc(sizeof(AjisaiGrayChunk));
+  if (manager->gray_stack.top == NULL)
+    return AJISAI_MEM_MANAGER_INIT_FAILED;
+  manager->gray_stack.top->prev = NULL;
+  manager->gray_stack.top->len = 0;
+  manager->gray_stack.spare = NULL;
+  manager->gray_stack.len = 0;
+
+  manager->sweep_epoch = 0;
+  manager->sweep_class = AJISAI_SIZE_CLASS_COUNT;
+  manager->sweep_cursor = NULL;
+  manager->marked_bytes = 0;
+  manager->gc_threshold = AJISAI_BITMAP_HEAP_MIN_GC_BYTES;
+  manager->gc_in_progress = false;
+  manager->root_scan_frame = NULL;
+  manager->root_scan_idx = 0;
+
+  manager->heap_bytes = 0;
+  manager->heap_limit = ajisai_heap_limit_from_env();
+  manager->gc_cycle_count = 0;
+  // 最初のオブジェクトの確保で一つ目のセグメントを確保するため、これより小さい上限では何も確保できない
+  if (manager->heap_limit != 0 && manager->heap_limit < AJISAI_SEGMENT_BYTES)
+    fprintf(stderr, "warning: heap limit %zu bytes is smaller than one heap segment (%d bytes); "
+            "every allocation will fail\n", manager->heap_limit, AJISAI_SEGMENT_BYTES);
+
+#ifdef AJISAI_HEAP_PROFILE
+  // ajisai_heap_profile_init が呼ばれるまではプロファイルを記録しない
+  manager->heap_profile = (AjisaiHeapProfile){};
+#endif // AJISAI_HEAP_PROFILE
+
+#ifdef AJISAI_MEMORY_MANAGER_DEBUG_OUTPUT
+  ajisai_mem_manager_display_stat(manager);
+#endif // AJISAI_MEMORY_MANAGER_DEBUG_OUTPUT
+
+  return AJISAI_SUCCESS;
+}
+
+static void ajisai_segment_delete(AjisaiSegment *segment) {
+  for (size_t w = 0; w < ajisai_segment_bitmap_words(segment); w++) {
+    for (uint64_t allocated = segment->alloc_bits[w]; allocated != 0; allocated &= allocated - 1)
+      ajisai_object_heap_free(ajisai_segment_object(segment, w * 64 + __builtin_ctzll(allocated)));
+  }
+  free(segment);
+}
+
+void ajisai_mem_manager_deinit(AjisaiMemManager *manager) {
+#ifdef AJISAI_HEAP_PROFILE
+  // プログラム終了時点で生存しているオブジェクトのプロファイルを出力する
+  ajisai_heap_profile_dump(manager);
+#endif // AJISAI_HEAP_PROFILE
+
+#ifdef AJISAI_MEMORY_MANAGER_DEBUG_OUTPUT
+  AJISAI_DEBUG_LOG("MEMORY MANAGER DEBUG", "mem_manager_deinit start\n");
+#endif // AJISAI_MEMORY_MANAGER_DEBUG_OUTPUT
+
+  // 未スイープのセグメントでは死んだオブジェクトも確保済みのままなので、ここでまとめて解放される
+  for (size_t i = 0; i < AJISAI_SIZE_CLASS_COUNT; i++) {
+    AjisaiSegment *segment = manager->size_classes[i].segments;
+    while (segment != NULL) {
+      AjisaiSegment *next = segment->next;
+      ajisai_segment_delete(segment);
+      segment = next;
+    }
+  }
+  while (manager->large_segments != NULL) {
+    AjisaiSegment *next = manager->large_segments->next;
+    ajisai_segment_delete(manager->large_segments);
+    manager->large_segments = next;
+  }
+  while (manager->gray_stack.top != NULL) {
+    AjisaiGrayChunk *prev = manager->gray_stack.top->prev;
+    free(manager->gray_stack.top);
+    manager->gray_stack.top = prev;
+  }
+  free(manager->gray_stack.spare);
+
+#ifdef AJISAI_HEAP_PROFILE
+  free(manager->heap_profile.stats);
+  manager->heap_profile.stats = NULL;
+#endif // AJISAI_HEAP_PROFILE
+
+#ifdef AJISAI_MEMORY_MANAGER_DEBUG_OUTPUT
+  AJISAI_DEBUG_LOG("MEMORY MANAGER DEBUG", "mem_manager_deinit end\n");
+#endif // AJISAI_MEMORY_MANAGER_DEBUG_OUTPUT
+}
+
+void ajisai_mem_manager_shade(AjisaiMemManager *manager, AjisaiObject *obj) {
+  if (!AJISAI_IS_HEAP_OBJ(obj))
+    return;
+
+  AjisaiSegment *segment = AJISAI_OBJ_GET_SEGMENT(obj);
+  // 前のサイクルのマークビットが残っているセグメントは、このサイクルのマークを付ける前にスイープする。
+  // 到達可能なオブジェクトは前のサイクルでもマークされているので、スイープで解放されることはない
+  if (segment->sweep_epoch != manager->sweep_epoch)
+    ajisai_mem_manager_sweep_segment(manager, segment);
+  size_t idx = ajisai_segment_object_index(segment, obj);
+  uint64_t bit = (uint64_t)1 << (idx % 64);
+  if (segment->mark_bits[idx / 64] & bit)
+    return;
+  segment->mark_bits[idx / 64] |= bit;
+  manager->marked_bytes += segment->slot_size + ajisai_object_payload_size(obj);
+
+  AjisaiGrayStack *gray_stack = &manager->gray_stack;
+  if (gray_stack->top->len == AJISAI_GRAY_CHUNK_CAPACITY) {
+    AjisaiGrayChunk *chunk = gray_stack->spare;
+    gray_stack->spare = NULL;
+    if (chunk == NULL && (chunk = malloc(sizeof(AjisaiGrayChunk))) == NULL)
+      ajisai_mem_manager_out_of_memory(manager, sizeof(AjisaiGrayChunk));
+    chunk->prev = gray_stack->top;
+    chunk->len = 0;
+    gray_stack->top = chunk;
+  }
+  gray_stack->top->objs[gray_stack->top->len++] = obj;
+  gray_stack->len++;
+}
+
+static AjisaiObject *ajisai_gray_stack_pop(AjisaiGrayStack *gray_stack) {
+  if (gray_stack->top->len == 0) {
+    free(gray_stack->spare);
+    gray_stack->spare = gray_stack->top;
+    gray_stack->top = gray_stack->top->prev;
+  }
+  gray_stack->len--;
+  return gray_stack->top->objs[--gray_stack->top->len];
+}
+
+// グレーのオブジェクトを最大 budget 個スキャンする
+static int ajisai_mem_manager_mark_step(AjisaiMemManager *manager, size_t budget) {
+  while (manager->gray_stack.len > 0) {
+    if (budget-- == 0)
+      return AJISAI_SCAN_PHASE_STILL_CONTINUES;
+    AjisaiObject *obj = ajisai_gray_stack_pop(&manager->gray_stack);
+    obj->type_info->scan_func(manager, obj);
+  }
+  return AJISAI_SCAN_PHASE_IS_SUCCESSFULLY_OVER;
+}
+
+static void ajisai_mem_manager_scan_root(AjisaiMemManager *manager, AjisaiObject *obj) {
+  ajisai_mem_manager_shade(manager, obj);
+}
+
+static void ajisai_mem_manager_start_cycle(AjisaiFuncFrame *func_frame) {
+  AjisaiMemManager *mem_manager = func_frame->mem_manager;
+
+  // 前のサイクルの遅延スイープが残っていても、ここでは完了させずにサイクル中に少しずつ進める。
+  // マークを付けるセグメントは ajisai_mem_manager_shade が、確保に使うセグメントは確保の際に先にスイープする
+  mem_manager->sweep_class = 0;
+  mem_manager->sweep_cursor = mem_manager->size_classes[0].segments;
+  mem_manager->gc_in_progress = true;
+  mem_manager->marked_bytes = 0;
+  ajisai_func_frame_begin_root_scan(func_frame);
+}
+
+// ルートの走査、前のサイクルのスイープ、マークが全て完了した後に呼び出す。全てのセグメントを未スイープとし、以降の確保の際に遅延スイープする
+static void ajisai_mem_manager_finish_cycle(AjisaiMemManager *mem_manager) {
+  mem_manager->gc_in_progress = false;
+  mem_manager->gc_cycle_count++;
+  mem_manager->sweep_epoch++;
+  for (size_t i = 0; i < AJISAI_SIZE_CLASS_COUNT; i++)
+    mem_manager->size_classes[i].alloc_cursor = mem_manager->size_classes[i].segments;
+  ajisai_mem_manager_sweep_large_segments(mem_manager);
+
+  mem_manager->gc_threshold = mem_manager->marked_bytes * 2;
+  if (mem_manager->gc_threshold < AJISAI_BITMAP_HEAP_MIN_GC_BYTES)
+    mem_manager->gc_threshold = AJISAI_BITMAP_HEAP_MIN_GC_BYTES;
+
+#ifdef AJISAI_MEMORY_MANAGER_DEBUG_OUTPUT
+  ajisai_mem_manager_display_stat(mem_manager);
+#endif // AJISAI_MEMORY_MANAGER_DEBUG_OUTPUT
+}
+
+static void ajisai_mem_manager_collect_all(AjisaiFuncFrame *func_frame) {
+  AjisaiMemManager *mem_manager = func_frame->mem_manager;
+
+  if (!mem_manager->gc_in_progress)
+    ajisai_mem_manager_start_cycle(func_frame);
+  ajisai_mem_manager_root_scan_step(mem_manager, SIZE_MAX);
+  ajisai_mem_manager_sweep_step(mem_manager, SIZE_MAX);
+  ajisai_mem_manager_mark_step(mem_manager, SIZE_MAX);
+  ajisai_mem_manager_finish_cycle(mem_manager);
+  ajisai_mem_manager_sweep_all(mem_manager);
+}
+
+// オブジェクトが一つも残っていないセグメントを解放する
+static void ajisai_mem_manager_release_empty_segments(AjisaiMemManager *manager) {
+  for (size_t i = 0; i < AJISAI_SIZE_CLASS_COUNT; i++) {
+    AjisaiSegment **link = &manager->size_classes[i].segments;
+    while (*link != NULL) {
+      AjisaiSegment *segment = *link;
+      bool empty = true;
+      for (size_t w = 0; w < ajisai_segment_bitmap_words(segment) && empty; w++)
+        empty = segment->alloc_bits[w] == 0;
+
+      if (empty) {
+        *link = segment->next;
+        manager->heap_bytes -= segment->bytes;
+        free(segment);
+      } else {
+        link = &segment->next;
+      }
+    }
+    manager->size_classes[i].alloc_cursor = manager->size_classes[i].segments;
+  }
+}
+
+// ヒープ上限に達しそうなとき、またはメモリ確保に失敗したときに呼び出す。
+// 進行中のサイクルは開始時点のルートしか見ていないため、それを完了させた上で改めて全体を回収し、
+// 空になったセグメントも解放する
+static void ajisai_mem_manager_emergency_collect(AjisaiFuncFrame *func_frame) {
+  AjisaiMemManager *mem_manager = func_frame->mem_manager;
+
+#ifdef AJISAI_MEMORY_MANAGER_DEBUG_OUTPUT
+  AJISAI_DEBUG_LOG("MEMORY MANAGER DEBUG", "emergency collection start (%zu bytes in use)\n", mem_manager->heap_bytes);
+#endif // AJISAI_MEMORY_MANAGER_DEBUG_OUTPUT
+
+  if (mem_manager->gc_in_progress)
+    ajisai_mem_manager_collect_all(func_frame);
+  ajisai_mem_manager_collect_all(func_frame);
+  ajisai_mem_manager_release_empty_segments(mem_manager);
+
+#ifdef AJISAI_MEMORY_MANAGER_DEBUG_OUTPUT
+  AJISAI_DEBUG_LOG("MEMORY MANAGER DEBUG", "emergency collection end (%zu bytes in use)\n", mem_manager->heap_bytes);
+#endif // AJISAI_MEMORY_MANAGER_DEBUG_OUTPUT
+}
+
+static void ajisai_mem_manager_out_of_memory(AjisaiMemManager *mem_manager, size_t requested) {
+  size_t object_cnt = 0, segment_cnt = 0, large_cnt = 0;
+
+  for (size_t i = 0; i < AJISAI_SIZE_CLASS_COUNT; i++) {
+    for (AjisaiSegment *segment = mem_manager->size_classes[i].segments; segment != NULL; segment = segment->next) {
+      segment_cnt++;
+      for (size_t w = 0; w < ajisai_segment_bitmap_words(segment); w++)
+        object_cnt += __builtin_popcountll(segment->alloc_bits[w]);
+    }
+  }
+  for (AjisaiSegment *segment = mem_manager->large_segments; segment != NULL; segment = segment->next) large_cnt++;
+
+  fflush(stdout);
+  fprintf(stderr, "error: out of memory (failed to allocate %zu bytes)\n", requested);
+  fprintf(stderr, "  heap in use:    %zu bytes\n", mem_manager->heap_bytes);
+  if (mem_manager->heap_limit > 0)
+    fprintf(stderr, "  heap limit:     %zu bytes\n", mem_manager->heap_limit);
+  else
+    fprintf(stderr, "  heap limit:     unlimited\n");
+  fprintf(stderr, "  live objects:   %zu\n", object_cnt + large_cnt);
+  fprintf(stderr, "  segments:       %zu (%zu large)\n", segment_cnt + large_cnt, large_cnt);
+  fprintf(stderr, "  gc cycles:      %zu\n", mem_manager->gc_cycle_count);
+  exit(1);
+}
+
+static AjisaiObject *ajisai_segment_take_slot(AjisaiMemManager *manager, AjisaiSegment *segment, size_t idx) {
+  uint64_t bit = (uint64_t)1 << (idx % 64);
+  segment->alloc_bits[idx / 64] |= bit;
+  // サイクル中に確保したオブジェクトはスキャン済み（黒）として扱う
+  if (manager->gc_in_progress) {
+    segment->mark_bits[idx / 64] |= bit;
+    manager->marked_bytes += segment->slot_size;
+  }
+  return ajisai_segment_object(segment, idx);
+}
+
+// alloc_cursor から順に、未スイープのセグメントをスイープしながら空きスロットを探す
+static AjisaiObject *ajisai_size_class_alloc(AjisaiMemManager *manager, AjisaiSizeClass *size_class) {
+  for (AjisaiSegment *segment = size_class->alloc_cursor; segment != NULL; segment = segment->next) {
+    if (segment->sweep_epoch != manager->sweep_epoch)
+      ajisai_mem_manager_sweep_segment(manager, segment);
+
+    size_t words = ajisai_segment_bitmap_words(segment);
+    for (size_t w = segment->alloc_word; w < words; w++) {
+      uint64_t free_bits = ~segment->alloc_bits[w];
+      if (w == words - 1 && segment->slot_count % 64 != 0)
+        free_bits &= ((uint64_t)1 << (segment->slot_count % 64)) - 1;
+
+      if (free_bits != 0) {
+        segment->alloc_word = w;
+        size_class->alloc_cursor = segment;
+        return ajisai_segment_take_slot(manager, segment, w * 64 + __builtin_ctzll(free_bits));
+      }
+    }
+    segment->alloc_word = words;
+  }
+  return NULL;
+}
+
+static AjisaiSegment *ajisai_mem_manager_new_segment(AjisaiFuncFrame *func_frame, size_t slot_size, bool large) {
+  AjisaiMemManager *mem_manager = func_frame->mem_manager;
+
+  AjisaiSegment *segment = ajisai_segment_new(slot_size, large, mem_manager->sweep_epoch);
+  if (segment == NULL) {
+    ajisai_mem_manager_emergency_collect(func_frame);
+    segment = ajisai_segment_new(slot_size, large, mem_manager->sweep_epoch);
+    if (segment == NULL)
+      ajisai_mem_manager_out_of_memory(mem_manager, ajisai_segment_bytes(slot_size, large));
+  }
+  mem_manager->heap_bytes += segment->bytes;
+  return segment;
+}
+
+static AjisaiObject *ajisai_mem_manager_alloc_small(AjisaiFuncFrame *func_frame, size_t class_idx) {
+  AjisaiMemManager *mem_manager = func_frame->mem_manager;
+  AjisaiSizeClass *size_class = &mem_manager->size_classes[class_idx];
+  size_t slot_size = ajisai_size_class_slot_sizes[class_idx];
+
+  AjisaiObject *obj = ajisai_size_class_alloc(mem_manager, size_class);
+  if (obj != NULL)
+    return obj;
+
+  // 緊急の GC が行われた場合は、空いたスロットを使う
+  size_t gc_cycle_count = mem_manager->gc_cycle_count;
+  ajisai_mem_manager_reserve(func_frame, AJISAI_SEGMENT_BYTES);
+  if (gc_cycle_count != mem_manager->gc_cycle_count
+      && (obj = ajisai_size_class_alloc(mem_manager, size_class)) != NULL)
+    return obj;
+
+  AjisaiSegment *segment = ajisai_mem_manager_new_segment(func_frame, slot_size, false);
+  segment->next = size_class->segments;
+  size_class->segments = size_class->alloc_cursor = segment;
+
+#ifdef AJISAI_MEMORY_MANAGER_DEBUG_OUTPUT
+  AJISAI_DEBUG_LOG("MEMORY MANAGER DEBUG", "add segment for %zu bytes slots\n", slot_size);
+#endif // AJISAI_MEMORY_MANAGER_DEBUG_OUTPUT
+
+  if (!mem_manager->gc_in_progress && mem_manager->heap_bytes > mem_manager->gc_threshold)
+    ajisai_mem_manager_start_cycle(func_frame);
+  return ajisai_size_class_alloc(mem_manager, size_class);
+}
+
+static AjisaiObject *ajisai_mem_manager_alloc_large(AjisaiFuncFrame *func_frame, size_t slot_size) {
+  AjisaiMemManager *mem_manager = func_frame->mem_manager;
+
+  ajisai_mem_manager_reserve(func_frame, ajisai_segment_bytes(slot_size, true));
+  AjisaiSegment *segment = ajisai_mem_manager_new_segment(func_frame, slot_size, true);
+  segment->next = mem_manager->large_segments;
+  mem_manager->large_segments = segment;
+
+  if (!mem_manager->gc_in_progress && mem_manager->heap_bytes > mem_manager->gc_threshold)
+    ajisai_mem_manager_start_cycle(func_frame);
+  return ajisai_segment_take_slot(mem_manager, segment, 0);
+}
+
+// payload_size はオブジェクトが別途 malloc で確保して所有するデータ（文字列の本体など）のサイズで、
+// ヒーププロファイルの記録にのみ使用する
+static AjisaiObject *ajisai_object_alloc_with_payload(
+  AjisaiFuncFrame *func_frame, size_t size, size_t payload_size) {
+  AjisaiMemManager *mem_manager = func_frame->mem_manager;
+  size_t slot_size = AJISAI_SLOT_HEADER_BYTES + size;
+  size_t class_idx = ajisai_size_class_index(slot_size);
+
+  AjisaiObject *obj = class_idx < AJISAI_SIZE_CLASS_COUNT
+    ? ajisai_mem_manager_alloc_small(func_frame, class_idx)
+    : ajisai_mem_manager_alloc_large(func_frame, slot_size);
+
+  if (mem_manager->gc_in_progress) {
+    bool roots_scanned = ajisai_mem_manager_root_scan_step(mem_manager, AJISAI_ROOT_SCAN_STEP);
+    bool swept = ajisai_mem_manager_sweep_step(mem_manager, AJISAI_BITMAP_HEAP_SWEEP_STEP);
+    if (ajisai_mem_manager_mark_step(mem_manager, AJISAI_BITMAP_HEAP_MARK_STEP) == AJISAI_SCAN_PHASE_IS_SUCCESSFULLY_OVER
+        && roots_scanned && swept)
+      ajisai_mem_manager_finish_cycle(mem_manager);
+  }
+
+#ifdef AJISAI_HEAP_PROFILE
+  ajisai_heap_profile_record_alloc(
+    mem_manager, func_frame->alloc_site, AJISAI_OBJ_GET_ALLOC_RECORD(obj), slot_size + payload_size);
+#endif // AJISAI_HEAP_PROFILE
+
+  return obj;
+}
+
+#else
+
+//
+// Treadmill によるヒープ
+//
+
 static AjisaiMemCellBlock *ajisai_memcell_block_new(size_t memcell_cnt) {
   AjisaiMemCellBlock *block = malloc(sizeof(AjisaiMemCellBlock));
   if (block == NULL)
@@ -21,8 +857,10 @@ static AjisaiMemCellBlock *ajisai_memcell_block_new(size_t memcell_cnt) {
 
   block->memcell_count = memcell_cnt;
   block->block = malloc(sizeof(AjisaiMemCell) * memcell_cnt);
-  if (block->block == NULL)
+  if (block->block == NULL) {
+    free(block);
     return NULL;
+  }
 
   block->memcell_next_idx = 0;
 
@@ -36,12 +874,13 @@ static void ajisai_memcell_block_delete(AjisaiMemCellBlock *block) {
 
 static void ajisai_memcell_allocator_deinit(AjisaiMemCellAllocator *allocator);
 
+#define AJISAI_MEMCELL_BLOCK_BYTES (sizeof(AjisaiMemCellBlock) + sizeof(AjisaiMemCell) * AJISAI_BLOCKS_MEMCELL_COUNT)
+
 static int ajisai_memcell_allocator_add_block(AjisaiMemCellAllocator *allocator) {
+  // NOTE: 実行中に失敗した場合も既存のブロックは使用中の MemCell を含むため、ここでは解放しない
   AjisaiMemCellBlock *new_block = ajisai_memcell_block_new(AJISAI_BLOCKS_MEMCELL_COUNT);
-  if (new_block == NULL) {
-    ajisai_memcell_allocator_deinit(allocator);
+  if (new_block == NULL)
     return AJISAI_MEMCELL_ALLOCATOR_ADD_BLOCK_FAILED;
-  }
   new_block->next = allocator->blocks;
   allocator->blocks = new_block;
   return AJISAI_SUCCESS;
@@ -84,6 +923,10 @@ static AjisaiMemCell *ajisai_memcell_allocator_alloc(AjisaiMemCellAllocator *all
   return &allocator->blocks->block[allocator->blocks->memcell_next_idx++];
 }
 
+static bool ajisai_memcell_allocator_is_full(AjisaiMemCellAllocator *allocator) {
+  return allocator->blocks->memcell_next_idx >= allocator->blocks->memcell_count;
+}
+
 static int ajisai_free_memcells_init(AjisaiFreeMemCells *free_memcells, AjisaiMemCellAllocator *allocator) {
   AjisaiMemCell *bottom_cell = ajisai_memcell_allocator_alloc(allocator, NULL);
   if (bottom_cell == NULL)
@@ -93,6 +936,7 @@ static int ajisai_free_memcells_init(AjisaiFreeMemCells *free_memcells, AjisaiMe
 
   free_memcells->bottom = bottom_cell;
   free_memcells->memcells = NULL;
+  free_memcells->trimmed = NULL;
   return AJISAI_SUCCESS;
 }
 
@@ -123,6 +967,34 @@ static void ajisai_free_memcells_add_memcell(AjisaiFreeMemCells *free_memcells,
   free_memcells->memcells = cell;
 }
 
+static AjisaiMemCell *ajisai_free_memcells_pop_trimmed(AjisaiFreeMemCells *free_memcells) {
+  AjisaiMemCell *cell = free_memcells->trimmed;
+  if (cell != NULL) {
+    free_memcells->trimmed = cell->next;
+    cell->next = cell->prev = NULL;
+  }
+  return cell;
+}
+
+// 空き MemCell が保持しているデータ領域を全て解放し、trimmed に移す。解放したバイト数を返す
+static size_t ajisai_free_memcells_trim(AjisaiFreeMemCells *free_memcells) {
+  size_t trimmed_bytes = 0;
+
+  while (free_memcells->memcells != NULL) {
+    AjisaiMemCell *cell = free_memcells->memcells;
+    free_memcells->memcells = cell->next;
+
+    trimmed_bytes += sizeof(AjisaiByteData) + cell->size;
+    free(cell->data);
+    cell->data = NULL;
+    cell->size = 0;
+
+    cell->next = free_memcells->trimmed;
+    free_memcells->trimmed = cell;
+  }
+  return trimmed_bytes;
+}
+
 #ifdef AJISAI_MEMORY_MANAGER_DEBUG_OUTPUT
 static void ajisai_mem_manager_display_stat(AjisaiMemManager *manager);
 #endif // AJISAI_MEMORY_MANAGER_DEBUG_OUTPUT
@@ -139,6 +1011,17 @@ int ajisai_mem_manager_init(AjisaiMemManager *manager) {
 
   manager->gc_in_progress = false;
   manager->live_color = AJISAI_WHITE;
+  manager->root_scan_frame = NULL;
+  manager->root_scan_idx = 0;
+
+  manager->heap_bytes = AJISAI_MEMCELL_BLOCK_BYTES;
+  manager->heap_limit = ajisai_heap_limit_from_env();
+  manager->gc_cycle_count = 0;
+
+#ifdef AJISAI_HEAP_PROFILE
+  // ajisai_heap_profile_init が呼ばれるまではプロファイルを記録しない
+  manager->heap_profile = (AjisaiHeapProfile){};
+#endif // AJISAI_HEAP_PROFILE
 
 #ifdef AJISAI_MEMORY_MANAGER_DEBUG_OUTPUT
   ajisai_mem_manager_display_stat(manager);
@@ -147,26 +1030,14 @@ int ajisai_mem_manager_init(AjisaiMemManager *manager) {
   return AJISAI_SUCCESS;
 }
 
-void ajisai_str_heap_free(AjisaiObject *obj);
-void ajisai_closure_heap_free(AjisaiObject *obj);
-
-static void ajisai_object_heap_free(AjisaiObject *obj) {
-  switch (AJISAI_OBJ_TAG(obj)) {
-    case AJISAI_OBJ_STR:
-      if (AJISAI_IS_HEAP_OBJ(obj))
-        ajisai_str_heap_free(obj);
-      break;
-    case AJISAI_OBJ_FUNC:
-      ajisai_closure_heap_free(obj);
-      break;
-    default:
-      break;
-  }
-}
-
 void ajisai_mem_manager_deinit(AjisaiMemManager *manager) {
   AjisaiMemCellBlock *blocks = manager->memcell_allocator.blocks;
 
+#ifdef AJISAI_HEAP_PROFILE
+  // プログラム終了時点で生存しているオブジェクトのプロファイルを出力する
+  ajisai_heap_profile_dump(manager);
+#endif // AJISAI_HEAP_PROFILE
+
 #ifdef AJISAI_MEMORY_MANAGER_DEBUG_OUTPUT
   AJISAI_DEBUG_LOG("MEMORY MANAGER DEBUG", "mem_manager_deinit start\n");
 #endif // AJISAI_MEMORY_MANAGER_DEBUG_OUTPUT
@@ -187,6 +1058,11 @@ void ajisai_mem_manager_deinit(AjisaiMemManager *manager) {
   }
   ajisai_memcell_allocator_deinit(&manager->memcell_allocator);
 
+#ifdef AJISAI_HEAP_PROFILE
+  free(manager->heap_profile.stats);
+  manager->heap_profile.stats = NULL;
+#endif // AJISAI_HEAP_PROFILE
+
 #ifdef AJISAI_MEMORY_MANAGER_DEBUG_OUTPUT
   AJISAI_DEBUG_LOG("MEMORY MANAGER DEBUG", "mem_manager_deinit end\n");
 #endif // AJISAI_MEMORY_MANAGER_DEBUG_OUTPUT
@@ -285,6 +1161,20 @@ static void ajisai_object_mark_alive(AjisaiObject *obj, AjisaiMemManager *mem_ma
     obj->tag |= AJISAI_BLACK_OBJ;
 }
 
+void ajisai_mem_manager_shade(AjisaiMemManager *manager, AjisaiObject *obj) {
+  // 文字列リテラルなどの静的なオブジェクトは GC の対象ではない
+  if (!AJISAI_IS_HEAP_OBJ(obj))
+    return;
+
+  if (!AJISAI_IS_GRAY_OBJ(obj) && !AJISAI_IS_ALIVE_OBJ(obj, manager)) {
+    AjisaiMemCell *cell = AJISAI_OBJ_GET_OWNER_CELL(obj);
+    AJISAI_MEMCELL_POP_OWN(manager, cell);
+    // 今後のスキャン対象としてマーク
+    obj->tag |= AJISAI_GRAY_OBJ;
+    ajisai_mem_manager_append_to_to_space(manager, cell);
+  }
+}
+
 static int ajisai_mem_manager_scan_obj_tree(AjisaiMemManager *manager) {
 #ifdef AJISAI_MEMORY_MANAGER_DEBUG_OUTPUT
   AJISAI_DEBUG_LOG("MEMORY MANAGER DEBUG", "scan_obj_tree ...\n");
@@ -331,7 +1221,12 @@ static void ajisai_mem_manager_release_from_space(AjisaiMemManager *manager) {
 
     AJISAI_MEMCELL_POP_OWN(manager, released);
 
+#ifdef AJISAI_HEAP_PROFILE
+    ajisai_heap_profile_record_free(manager, &released->data->alloc_record);
+#endif // AJISAI_HEAP_PROFILE
+
     AjisaiObject *obj = (AjisaiObject *)released->data->data;
+    manager->heap_bytes -= ajisai_object_payload_size(obj);
     ajisai_object_heap_free(obj);
 
     released->next = manager->free.memcells;
@@ -350,79 +1245,151 @@ static void ajisai_mem_manager_release_from_space(AjisaiMemManager *manager) {
 #endif // AJISAI_MEMORY_MANAGER_DEBUG_OUTPUT
 }
 
-static void ajisai_func_frame_scan_roots(AjisaiFuncFrame *func_frame) {
-  AjisaiMemManager *manager = func_frame->mem_manager;
+// 前のサイクルの後に確保されたオブジェクトは生存の色が反転後の色と一致しうるので、ルートからは色によらずスキャン対象にする
+static void ajisai_mem_manager_scan_root(AjisaiMemManager *manager, AjisaiObject *obj) {
+  if (AJISAI_IS_HEAP_OBJ(obj) && !AJISAI_IS_GRAY_OBJ(obj)) {
+    AjisaiMemCell *cell = AJISAI_OBJ_GET_OWNER_CELL(obj);
+    AJISAI_MEMCELL_POP_OWN(manager, cell);
+    // スキャン中のフラグ (AJISAI_GRAY_OBJ) を立てる
+    obj->tag |= AJISAI_GRAY_OBJ;
+    ajisai_mem_manager_append_to_to_space(manager, cell);
+  }
+}
 
-#ifdef AJISAI_MEMORY_MANAGER_DEBUG_OUTPUT
-  AJISAI_DEBUG_LOG("MEMORY MANAGER DEBUG", "scan_roots start\n");
-  int scanned_cell_count = 0;
-#endif // AJISAI_MEMORY_MANAGER_DEBUG_OUTPUT
+static void ajisai_mem_manager_start_cycle(AjisaiFuncFrame *func_frame) {
+  AjisaiMemManager *mem_manager = func_frame->mem_manager;
+  mem_manager->gc_in_progress = true;
 
-  for (AjisaiFuncFrame *frame = func_frame; frame != NULL; frame = frame->parent) {
-#ifdef AJISAI_MEMORY_MANAGER_DEBUG_OUTPUT
-    AJISAI_DEBUG_LOG("MEMORY MANAGER DEBUG", "\tscanning frame %p ...\n", frame);
-#endif // AJISAI_MEMORY_MANAGER_DEBUG_OUTPUT
+  // 生きているオブジェクトの色を反転させることで、全てのオブジェクトの生存フラグを外す
+  if (mem_manager->live_color == AJISAI_WHITE)
+    mem_manager->live_color = AJISAI_BLACK;
+  else
+    mem_manager->live_color = AJISAI_WHITE;
+
+  ajisai_func_frame_begin_root_scan(func_frame);
+}
+
+// ルートとオブジェクトのスキャンが完了した後に呼び出し、From 空間に残ったオブジェクトを解放してサイクルを終える
+static void ajisai_mem_manager_finish_cycle(AjisaiMemManager *mem_manager) {
+  ajisai_mem_manager_release_from_space(mem_manager);
+  mem_manager->top = mem_manager->scan = mem_manager->free.new_edge.prev;
+  mem_manager->gc_in_progress = false;
+  mem_manager->gc_cycle_count++;
+}
+
+static void ajisai_mem_manager_collect_all(AjisaiFuncFrame *func_frame) {
+  AjisaiMemManager *mem_manager = func_frame->mem_manager;
+
+  if (!mem_manager->gc_in_progress)
+    ajisai_mem_manager_start_cycle(func_frame);
+  ajisai_mem_manager_root_scan_step(mem_manager, SIZE_MAX);
+  while (ajisai_mem_manager_scan_obj_tree(mem_manager) == AJISAI_SCAN_PHASE_STILL_CONTINUES);
+  ajisai_mem_manager_finish_cycle(mem_manager);
+}
 
-    for (size_t i = 0; i < frame->root_table_size; i++) {
-      AjisaiObject *obj = frame->root_table[i];
-      if (obj != NULL && AJISAI_IS_HEAP_OBJ(obj) && !AJISAI_IS_GRAY_OBJ(obj)) {
-        AjisaiMemCell *cell = AJISAI_OBJ_GET_OWNER_CELL(obj);
-        AJISAI_MEMCELL_POP_OWN(manager, cell);
-        // スキャン中のフラグ (AJISAI_GRAY_OBJ) を立てる
-        obj->tag |= AJISAI_GRAY_OBJ;
-        ajisai_mem_manager_append_to_to_space(manager, cell);
+// ヒープ上限に達しそうなとき、またはメモリ確保に失敗したときに呼び出す。
+// 進行中のサイクルは開始時点のルートしか見ていないため、それを完了させた上で改めて全体を回収し、
+// 空き MemCell が保持しているデータ領域も解放する
+static void ajisai_mem_manager_emergency_collect(AjisaiFuncFrame *func_frame) {
+  AjisaiMemManager *mem_manager = func_frame->mem_manager;
 
 #ifdef AJISAI_MEMORY_MANAGER_DEBUG_OUTPUT
-        scanned_cell_count++;
+  AJISAI_DEBUG_LOG("MEMORY MANAGER DEBUG", "emergency collection start (%zu bytes in use)\n", mem_manager->heap_bytes);
 #endif // AJISAI_MEMORY_MANAGER_DEBUG_OUTPUT
-      }
-    }
-  }
+
+  if (mem_manager->gc_in_progress)
+    ajisai_mem_manager_collect_all(func_frame);
+  ajisai_mem_manager_collect_all(func_frame);
+  mem_manager->heap_bytes -= ajisai_free_memcells_trim(&mem_manager->free);
 
 #ifdef AJISAI_MEMORY_MANAGER_DEBUG_OUTPUT
-  AJISAI_DEBUG_LOG("MEMORY MANAGER DEBUG", "scan_roots end (%d cells going to to-space)\n", scanned_cell_count);
-  ajisai_mem_manager_display_stat(manager);
+  AJISAI_DEBUG_LOG("MEMORY MANAGER DEBUG", "emergency collection end (%zu bytes in use)\n", mem_manager->heap_bytes);
 #endif // AJISAI_MEMORY_MANAGER_DEBUG_OUTPUT
 }
 
-AjisaiObject *ajisai_object_alloc(AjisaiFuncFrame *func_frame, size_t size) {
+static void ajisai_mem_manager_out_of_memory(AjisaiMemManager *mem_manager, size_t requested) {
+  size_t object_cnt = 0, free_cnt = 0, trimmed_cnt = 0, block_cnt = 0;
+
+  for (AjisaiMemCell *cell = mem_manager->free.bottom->next; cell != &mem_manager->free.new_edge; cell = cell->next)
+    object_cnt++;
+  for (AjisaiMemCell *cell = mem_manager->free.memcells; cell != NULL; cell = cell->next) free_cnt++;
+  for (AjisaiMemCell *cell = mem_manager->free.trimmed; cell != NULL; cell = cell->next) trimmed_cnt++;
+  for (AjisaiMemCellBlock *block = mem_manager->memcell_allocator.blocks; block != NULL; block = block->next)
+    block_cnt++;
+
+  fflush(stdout);
+  fprintf(stderr, "error: out of memory (failed to allocate %zu bytes)\n", requested);
+  fprintf(stderr, "  heap in use:    %zu bytes\n", mem_manager->heap_bytes);
+  if (mem_manager->heap_limit > 0)
+    fprintf(stderr, "  heap limit:     %zu bytes\n", mem_manager->heap_limit);
+  else
+    fprintf(stderr, "  heap limit:     unlimited\n");
+  fprintf(stderr, "  live objects:   %zu\n", object_cnt);
+  fprintf(stderr, "  free memcells:  %zu (%zu trimmed)\n", free_cnt + trimmed_cnt, trimmed_cnt);
+  fprintf(stderr, "  memcell blocks: %zu\n", block_cnt);
+  fprintf(stderr, "  gc cycles:      %zu\n", mem_manager->gc_cycle_count);
+  exit(1);
+}
+
+static AjisaiMemCell *ajisai_mem_manager_new_memcell(AjisaiFuncFrame *func_frame) {
   AjisaiMemManager *mem_manager = func_frame->mem_manager;
-  AjisaiMemCell *cell = ajisai_free_memcells_pop_memcell(&mem_manager->free, size);
 
+  AjisaiMemCell *cell = ajisai_free_memcells_pop_trimmed(&mem_manager->free);
+  if (cell != NULL)
+    return cell;
+
+  if (ajisai_memcell_allocator_is_full(&mem_manager->memcell_allocator)) {
+    ajisai_mem_manager_reserve(func_frame, AJISAI_MEMCELL_BLOCK_BYTES);
+    // 緊急の GC によって trimmed に MemCell が戻っている場合はそちらを使う
+    if ((cell = ajisai_free_memcells_pop_trimmed(&mem_manager->free)) != NULL)
+      return cell;
+  }
+
+  bool allocate_block;
+  cell = ajisai_memcell_allocator_alloc(&mem_manager->memcell_allocator, &allocate_block);
   if (cell == NULL) {
-    bool allocate_block;
+    ajisai_mem_manager_emergency_collect(func_frame);
+    if ((cell = ajisai_free_memcells_pop_trimmed(&mem_manager->free)) != NULL)
+      return cell;
     cell = ajisai_memcell_allocator_alloc(&mem_manager->memcell_allocator, &allocate_block);
     if (cell == NULL)
-      return NULL;
-
-    if (allocate_block && !mem_manager->gc_in_progress) {
-      mem_manager->gc_in_progress = true;
-
-      // 生きているオブジェクトの色を反転させることで、全てのオブジェクトの生存フラグを外す
-      if (mem_manager->live_color == AJISAI_WHITE)
-        mem_manager->live_color = AJISAI_BLACK;
-      else
-        mem_manager->live_color = AJISAI_WHITE;
+      ajisai_mem_manager_out_of_memory(mem_manager, AJISAI_MEMCELL_BLOCK_BYTES);
+  }
+  if (allocate_block) {
+    mem_manager->heap_bytes += AJISAI_MEMCELL_BLOCK_BYTES;
+    if (!mem_manager->gc_in_progress)
+      ajisai_mem_manager_start_cycle(func_frame);
+  }
+  return cell;
+}
 
-      ajisai_func_frame_scan_roots(func_frame);
-    }
+// payload_size はオブジェクトが別途 malloc で確保して所有するデータ（文字列の本体など）のサイズで、
+// ヒーププロファイルの記録にのみ使用する
+static AjisaiObject *ajisai_object_alloc_with_payload(
+  AjisaiFuncFrame *func_frame, size_t size, size_t payload_size) {
+  AjisaiMemManager *mem_manager = func_frame->mem_manager;
+  AjisaiMemCell *cell = ajisai_free_memcells_pop_memcell(&mem_manager->free, size);
 
+  if (cell == NULL) {
+    cell = ajisai_mem_manager_new_memcell(func_frame);
+    cell->data = ajisai_mem_manager_malloc(func_frame, sizeof(AjisaiByteData) + size);
     cell->size = size;
-    cell->data = malloc(sizeof(AjisaiByteData) + cell->size);
-    if (cell->data == NULL)
-      return NULL;
     cell->data->owner_cell = cell;
   }
 
-  if (mem_manager->gc_in_progress
-      && ajisai_mem_manager_scan_obj_tree(mem_manager) == AJISAI_SCAN_PHASE_STILL_CONTINUES) {
+  bool cycle_continues = false;
+  if (mem_manager->gc_in_progress) {
+    // ルートの走査中に To 空間へ移されたオブジェクトも後続のスキャンで処理される
+    bool roots_scanned = ajisai_mem_manager_root_scan_step(mem_manager, AJISAI_ROOT_SCAN_STEP);
+    cycle_continues = ajisai_mem_manager_scan_obj_tree(mem_manager) == AJISAI_SCAN_PHASE_STILL_CONTINUES
+      || !roots_scanned;
+  }
+
+  if (cycle_continues) {
     ajisai_mem_manager_append_to_new_space(mem_manager, cell);
   } else {
-    if (mem_manager->gc_in_progress) {
-      ajisai_mem_manager_release_from_space(mem_manager);
-      mem_manager->top = mem_manager->scan = mem_manager->free.new_edge.prev;
-      mem_manager->gc_in_progress = false;
-    }
+    if (mem_manager->gc_in_progress)
+      ajisai_mem_manager_finish_cycle(mem_manager);
     // NOTE: 以下の関数によって cell の持つデータへのポインタは直前まで bottom が指していた
     //       MemCell にコピーされる。
     //       cell 変数が指す MemCell は Free 空間の From 空間側の末端として使用する
@@ -436,20 +1403,26 @@ AjisaiObject *ajisai_object_alloc(AjisaiFuncFrame *func_frame, size_t size) {
   ajisai_mem_manager_display_stat(mem_manager);
 #endif // AJISAI_MEMORY_MANAGER_DEBUG_OUTPUT
 
+#ifdef AJISAI_HEAP_PROFILE
+  ajisai_heap_profile_record_alloc(
+    mem_manager, func_frame->alloc_site, &cell->data->alloc_record, sizeof(AjisaiByteData) + size + payload_size);
+#endif // AJISAI_HEAP_PROFILE
+
   return (AjisaiObject *)cell->data->data;
 }
 
+#endif // AJISAI_BITMAP_HEAP
+
+AjisaiObject *ajisai_object_alloc(AjisaiFuncFrame *func_frame, size_t size) {
+  return ajisai_object_alloc_with_payload(func_frame, size, 0);
+}
+
 void ajisai_gc_start(AjisaiFuncFrame *func_frame) {
-  AjisaiMemManager *mem_manager = func_frame->mem_manager;
+  ajisai_mem_manager_collect_all(func_frame);
 
-  if (!mem_manager->gc_in_progress) {
-    mem_manager->gc_in_progress = true;
-    ajisai_func_frame_scan_roots(func_frame);
-  }
-  while (ajisai_mem_manager_scan_obj_tree(mem_manager) == AJISAI_SCAN_PHASE_STILL_CONTINUES);
-  ajisai_mem_manager_release_from_space(mem_manager);
-  mem_manager->top = mem_manager->scan = mem_manager->free.new_edge.prev;
-  mem_manager->gc_in_progress = false;
+#ifdef AJISAI_HEAP_PROFILE
+  ajisai_heap_profile_dump(func_frame->mem_manager);
+#endif // AJISAI_HEAP_PROFILE
 }
 
 void ajisai_print_i32(AjisaiFuncFrame *func_frame, int32_t value) {
@@ -485,16 +1458,8 @@ void ajisai_flush(AjisaiFuncFrame *func_frame) {
 
 static void ajisai_str_scan_func(AjisaiMemManager *mem_manager, AjisaiObject *obj) {
   AjisaiString *str = (AjisaiString *)obj;
-  if (AJISAI_OBJ_TAG(&str->obj_header) == AJISAI_OBJ_STR_SLICE) {
-    AjisaiMemCell *cell = AJISAI_OBJ_GET_OWNER_CELL((AjisaiObject *)str->src);
-    if (!AJISAI_IS_GRAY_OBJ((AjisaiObject *)str->src)
-        && !AJISAI_IS_ALIVE_OBJ((AjisaiObject *)str->src, mem_manager)) {
-      AJISAI_MEMCELL_POP_OWN(mem_manager, cell);
-      // 今後のスキャン対象としてマーク
-      ((AjisaiObject *)str->src)->tag |= AJISAI_GRAY_OBJ;
-      ajisai_mem_manager_append_to_to_space(mem_manager, cell);
-    }
-  }
+  if (AJISAI_OBJ_TAG(&str->obj_header) == AJISAI_OBJ_STR_SLICE)
+    ajisai_mem_manager_shade(mem_manager, (AjisaiObject *)str->src);
 }
 
 AjisaiTypeInfo *ajisai_str_type_info(void) {
@@ -521,7 +1486,10 @@ static AjisaiString *ajisai_str_new(
   if (len == 0)
     return ajisai_empty_str();
 
-  AjisaiString *new_str = (AjisaiString *)ajisai_object_alloc(func_frame, sizeof(AjisaiString));
+  // スライスは元の文字列のデータを参照するだけなので、文字列データの分は含めない
+  size_t payload_size = tag == AJISAI_OBJ_STR ? len + 1 : 0;
+  AjisaiString *new_str =
+    (AjisaiString *)ajisai_object_alloc_with_payload(func_frame, sizeof(AjisaiString), payload_size);
   new_str->obj_header.tag = tag | AJISAI_HEAP_OBJ;
   new_str->obj_header.type_info = ajisai_str_type_info();
   new_str->len = len;
@@ -548,7 +1516,7 @@ AjisaiString *ajisai_str_concat(AjisaiFuncFrame *func_frame, AjisaiString *a, Aj
     return ajisai_empty_str();
 
   new_str_len = a_str_len + b_str_len;
-  new_str_data = malloc(new_str_len + 1);
+  new_str_data = ajisai_mem_manager_malloc(func_frame, new_str_len + 1);
 
   memcpy(new_str_data, a->value, a_str_len);
   memcpy(new_str_data + a_str_len, b->value, b_str_len);
@@ -590,13 +1558,13 @@ bool ajisai_str_equal(AjisaiFuncFrame *func_frame, AjisaiString *left, AjisaiStr
 }
 
 AjisaiString *ajisai_str_repeat(AjisaiFuncFrame *func_frame, AjisaiString *src, int32_t count) {
-  if (count == 0)
+  if (count == 0 || src->len == 0)
     return ajisai_empty_str();
   if (count == 1)
     return src;
 
   size_t new_str_len = src->len * count;
-  char *new_str_data = malloc(new_str_len + 1);
+  char *new_str_data = ajisai_mem_manager_malloc(func_frame, new_str_len + 1);
 
   for (int32_t i = 0; i < count; i++)
     memcpy(new_str_data + src->len * i, src->value, src->len);
@@ -5,10 +5,74 @@
 #include <stdint.h>
 #include <string.h>
 
+typedef struct AjisaiObject AjisaiObject;
+typedef struct AjisaiFuncFrame AjisaiFuncFrame;
+
+#ifdef AJISAI_HEAP_PROFILE
+// オブジェクトを確保したアロケーションサイトの ID と、サンプリングされた場合はその重み（推定バイト数と推定個数）
+typedef struct {
+  uint32_t alloc_site;
+  float sampled_objects;
+  size_t sampled_bytes;
+} AjisaiAllocRecord;
+#endif // AJISAI_HEAP_PROFILE
+
+// AJISAI_BITMAP_HEAP を定義すると、Treadmill の代わりにサイズクラスごとのセグメントと
+// マークビットマップによるヒープを使用する
+#ifdef AJISAI_BITMAP_HEAP
+
+#ifndef AJISAI_SEGMENT_BYTES
+#define AJISAI_SEGMENT_BYTES (64 * 1024)
+#endif // AJISAI_SEGMENT_BYTES
+
+// 最小のスロットサイズ (16 バイト) でセグメントを埋めた場合のスロット数を表現できるだけのワード数
+#define AJISAI_SEGMENT_BITMAP_WORDS (AJISAI_SEGMENT_BYTES / 16 / 64)
+#define AJISAI_SIZE_CLASS_COUNT 8
+
+// 最大のサイズクラスに収まらないオブジェクトは、一つのオブジェクトだけを持つ大きなセグメントに置く
+typedef struct AjisaiSegment AjisaiSegment;
+struct AjisaiSegment {
+  AjisaiSegment *next;
+  size_t bytes;
+  size_t slot_size, slot_count;
+  uint8_t *slots;
+  // 次の空きスロットを探し始めるワードの位置
+  size_t alloc_word;
+  // sweep_epoch が AjisaiMemManager の sweep_epoch と異なるセグメントは未スイープ
+  size_t sweep_epoch;
+  uint64_t alloc_bits[AJISAI_SEGMENT_BITMAP_WORDS];
+  uint64_t mark_bits[AJISAI_SEGMENT_BITMAP_WORDS];
+};
+
+typedef struct {
+  AjisaiSegment *segments, *alloc_cursor;
+} AjisaiSizeClass;
+
+// グレーのオブジェクトのスタックは固定長のチャンクをつないで伸ばし、伸ばす際に既存の要素をコピーしない
+#define AJISAI_GRAY_CHUNK_CAPACITY 1024
+
+typedef struct AjisaiGrayChunk AjisaiGrayChunk;
+struct AjisaiGrayChunk {
+  AjisaiGrayChunk *prev;
+  size_t len;
+  AjisaiObject *objs[AJISAI_GRAY_CHUNK_CAPACITY];
+};
+
+// top は常に一つ以上のチャンクを指す。空になったチャンクは一つだけ spare として取っておく
+typedef struct {
+  AjisaiGrayChunk *top, *spare;
+  size_t len;
+} AjisaiGrayStack;
+
+#else
+
 typedef struct AjisaiMemCell AjisaiMemCell;
 
 typedef struct {
   AjisaiMemCell *owner_cell;
+#ifdef AJISAI_HEAP_PROFILE
+  AjisaiAllocRecord alloc_record;
+#endif // AJISAI_HEAP_PROFILE
   uint8_t data[];
 } AjisaiByteData;
 
@@ -45,27 +109,94 @@ typedef struct {
 #define AJISAI_BLOCKS_MEMCELL_COUNT 512
 #endif // AJISAI_BLOCKS_MEMCELL_COUNT
 
+// ヒープ上限に達したときのトリミングでデータ領域を解放された MemCell は trimmed に繋がれ、
+// 新しい MemCell の代わりに再利用される
 typedef struct {
-  AjisaiMemCell *memcells;
+  AjisaiMemCell *memcells, *trimmed;
   AjisaiMemCell new_edge, *bottom;
 } AjisaiFreeMemCells;
 
+#endif // AJISAI_BITMAP_HEAP
+
+// ヒープ使用量の上限（バイト数）。0 の場合は上限を設けない。
+// 実行時には環境変数 AJISAI_HEAP_LIMIT（K / M / G の接尾辞を使用可能）で上書きできる
+#ifndef AJISAI_HEAP_LIMIT
+#define AJISAI_HEAP_LIMIT 0
+#endif // AJISAI_HEAP_LIMIT
+
 typedef enum {
   AJISAI_WHITE,
   AJISAI_BLACK,
 } AjisaiObjColor;
 
+#ifdef AJISAI_HEAP_PROFILE
+// コード生成器が出力するアロケーションサイトの情報。ID 0 は不明なサイトとして予約されている
+typedef struct {
+  const char *func_name;
+  const char *location;
+} AjisaiAllocSite;
+
+// サンプリングした確保の重みの合計。確保されたバイト数とオブジェクト数の推定値となる
+typedef struct {
+  size_t alloc_bytes, live_bytes;
+  double alloc_objects, live_objects;
+} AjisaiAllocSiteStat;
+
+// サンプリングの間隔（バイト数）の平均。間隔はこの値を平均とする指数分布から引く
+#ifndef AJISAI_HEAP_PROFILE_SAMPLE_BYTES
+#define AJISAI_HEAP_PROFILE_SAMPLE_BYTES 512
+#endif // AJISAI_HEAP_PROFILE_SAMPLE_BYTES
+
 typedef struct {
+  const AjisaiAllocSite *sites;
+  AjisaiAllocSiteStat *stats;
+  size_t site_count;
+  // 次にサンプリングするまでの残りバイト数。超過した分は次の間隔に持ち越すため負にもなる
+  int64_t bytes_until_sample;
+  uint64_t rng_state;
+  unsigned dump_count;
+} AjisaiHeapProfile;
+#endif // AJISAI_HEAP_PROFILE
+
+typedef struct {
+#ifdef AJISAI_BITMAP_HEAP
+  AjisaiSizeClass size_classes[AJISAI_SIZE_CLASS_COUNT];
+  AjisaiSegment *large_segments;
+  AjisaiGrayStack gray_stack;
+  size_t sweep_epoch;
+  // サイクル中に、前のサイクルから未スイープのまま残ったセグメントを少しずつスイープするための位置
+  size_t sweep_class;
+  AjisaiSegment *sweep_cursor;
+  // セグメントの追加時に heap_bytes が gc_threshold を超えていたら GC サイクルを開始する。
+  // gc_threshold は直前のサイクルでマークされたバイト数の 2 倍とする
+  size_t marked_bytes, gc_threshold;
+#else
   AjisaiMemCellAllocator memcell_allocator;
   AjisaiMemCell *top, *scan;
   AjisaiFreeMemCells free;
-  bool gc_in_progress;
   AjisaiObjColor live_color;
+#endif // AJISAI_BITMAP_HEAP
+  bool gc_in_progress;
+  // サイクルの開始時には実行中のフレームのルートだけを走査し、その呼び出し元のフレーム（root_scan_frame 以下）は
+  // オブジェクトの確保ごとに少しずつ走査する。root_scan_idx は root_scan_frame の次に走査するルートの位置
+  AjisaiFuncFrame *root_scan_frame;
+  size_t root_scan_idx;
+  // heap_bytes は MemCell のブロック（またはセグメント）、オブジェクトのデータ領域、文字列の本体の合計
+  size_t heap_bytes, heap_limit;
+  size_t gc_cycle_count;
+#ifdef AJISAI_HEAP_PROFILE
+  AjisaiHeapProfile heap_profile;
+#endif // AJISAI_HEAP_PROFILE
 } AjisaiMemManager;
 
 int ajisai_mem_manager_init(AjisaiMemManager *manager);
 void ajisai_mem_manager_deinit(AjisaiMemManager *manager);
+#ifndef AJISAI_BITMAP_HEAP
 void ajisai_mem_manager_append_to_to_space(AjisaiMemManager *manager, AjisaiMemCell *cell);
+#endif // AJISAI_BITMAP_HEAP
+#ifdef AJISAI_HEAP_PROFILE
+int ajisai_heap_profile_init(AjisaiMemManager *manager, const AjisaiAllocSite *sites, size_t site_count);
+#endif // AJISAI_HEAP_PROFILE
 
 typedef enum {
   AJISAI_OBJ_STR,
@@ -80,8 +211,6 @@ enum {
   AJISAI_OBJ_TAG_MASK  = 0x0000ffff,
 };
 
-typedef struct AjisaiObject AjisaiObject;
-
 typedef struct {
   void (*scan_func)(AjisaiMemManager *, AjisaiObject *);
 } AjisaiTypeInfo;
@@ -96,7 +225,9 @@ struct AjisaiObject {
 #define AJISAI_IS_HEAP_OBJ(obj) ((obj)->tag & AJISAI_HEAP_OBJ)
 #define AJISAI_IS_GRAY_OBJ(obj) ((obj)->tag & AJISAI_GRAY_OBJ)
 #define AJISAI_IS_ALIVE_OBJ(obj, manager) ((manager)->live_color == AJISAI_BLACK ? ((obj)->tag & AJISAI_BLACK_OBJ) : !((obj)->tag & AJISAI_BLACK_OBJ))
+#ifndef AJISAI_BITMAP_HEAP
 #define AJISAI_OBJ_GET_OWNER_CELL(obj) ((AjisaiByteData *)((uint8_t *)(obj) - sizeof(AjisaiByteData)))->owner_cell
+#endif // AJISAI_BITMAP_HEAP
 
 typedef struct AjisaiString AjisaiString;
 struct AjisaiString {
@@ -114,16 +245,29 @@ struct AjisaiClosure {
   void (*scan_func)(AjisaiMemManager *, AjisaiObject *);
 };
 
-typedef struct AjisaiFuncFrame AjisaiFuncFrame;
 struct AjisaiFuncFrame {
   AjisaiFuncFrame *parent;
   AjisaiMemManager *mem_manager;
   size_t root_table_size;
   AjisaiObject **root_table;
+#ifdef AJISAI_HEAP_PROFILE
+  // このフレームで直近に実行される、オブジェクトを確保しうる式のアロケーションサイト ID
+  uint32_t alloc_site;
+#endif // AJISAI_HEAP_PROFILE
 };
 
 AjisaiObject *ajisai_object_alloc(AjisaiFuncFrame *func_frame, size_t size);
 void ajisai_gc_start(AjisaiFuncFrame *func_frame);
+// GC サイクル中に、まだスキャン対象になっていないオブジェクトをスキャン対象に加える
+void ajisai_mem_manager_shade(AjisaiMemManager *manager, AjisaiObject *obj);
+void ajisai_mem_manager_root_barrier(AjisaiFuncFrame *func_frame);
+
+// 関数から戻る直前に呼び出す（リターンバリア）。戻り先のフレームのルートがまだ走査されていなければ、
+// 呼び出し元が実行を再開してルートを書き換える前にここで走査する
+static inline void ajisai_func_frame_leave(AjisaiFuncFrame *func_frame) {
+  if (func_frame->parent != NULL && func_frame->parent == func_frame->mem_manager->root_scan_frame)
+    ajisai_mem_manager_root_barrier(func_frame);
+}
 
 void ajisai_print_i32(AjisaiFuncFrame *func_frame, int32_t value);
 void ajisai_println_i32(AjisaiFuncFrame *func_frame, int32_t value);